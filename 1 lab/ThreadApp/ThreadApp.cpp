@@ -1,21 +1,17 @@
 #include "stdafx.h"
-#include <windows.h>
-#include <string>
-#include <iostream>
+#include "../../common/Threading.h"
 
-DWORD WINAPI ThreadProc(CONST LPVOID lpParam)
+void ThreadProc(unsigned int threadNumber)
 {
-    unsigned int threadNumber = *(unsigned int*)lpParam;
-
     std::cout << " #" << threadNumber << "   " << std::endl;
-
-    ExitThread(0);
 }
 
 int main(int argc, char* argv[])
 {
+#ifdef _WIN32
     SetConsoleCP(1251);
     SetConsoleOutputCP(1251);
+#endif
 
     if (argc != 2)
     {
@@ -33,37 +29,35 @@ int main(int argc, char* argv[])
         return 1;
     }
 
-    HANDLE* handles = new HANDLE[N];
-    unsigned int* threadNumbers = new unsigned int[N]; 
+    std::vector<Thread> threads;
+    threads.reserve(N);
 
     for (int i = 0; i < N; i++)
     {
-        threadNumbers[i] = i + 1; 
-        handles[i] = CreateThread(NULL, 0, &ThreadProc, &threadNumbers[i], CREATE_SUSPENDED, NULL);
+        unsigned int threadNumber = i + 1;
 
-        if (handles[i] == NULL)
+        try
+        {
+            threads.emplace_back([threadNumber]() { ThreadProc(threadNumber); }, true);
+        }
+        catch (const std::system_error&)
         {
-            std::cout << "    " << (i + 1) << std::endl;
+            std::cout << "    " << threadNumber << std::endl;
 
             return 1;
         }
     }
 
-    for (int i = 0; i < N; i++)
+    for (Thread& thread : threads)
     {
-        ResumeThread(handles[i]);
+        thread.Resume();
     }
 
-    WaitForMultipleObjects(N, handles, TRUE, INFINITE);
-
-    for (int i = 0; i < N; i++)
+    for (Thread& thread : threads)
     {
-        CloseHandle(handles[i]);
+        thread.Join();
     }
 
-    delete[] handles;
-    delete[] threadNumbers;
-
     std::cout << "   .  ." << std::endl;
 
     return 0;
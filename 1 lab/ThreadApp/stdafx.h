@@ -4,5 +4,8 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <system_error>
 
-#include <windows.h>
\ No newline at end of file
+#ifdef _WIN32
+#include <windows.h>
+#endif
\ No newline at end of file
@@ -1,30 +1,64 @@
 #include "BMP.h"
+#include "TileScheduler.h"
+#include "WorkerPool.h"
+#include "../../common/MappedBitmap.h"
+#include "../../common/Benchmark.h"
+#include "../../common/PerfCounters.h"
+#include "../../common/Topology.h"
 #include <iostream>
 #include <vector>
-#include <windows.h>
 #include <chrono>
 #include <cstring>
 #include <thread>
-#include <random>
 #include <algorithm>
 
 using namespace std;
 
+enum class BlurMode {
+    Reference,
+    SlidingWindow
+};
+
+// Workers read from the shared, read-only source and write disjoint tiles
+// of the shared destination, so a pass never observes its own output.
+// Tiles are pulled from the scheduler until none are left: squareSize
+// squares for the reference kernel, full-width bands squareSize rows high
+// for the sliding window.
 struct Params {
-    Bitmap* in = nullptr;
-    vector<pair<uint32_t, uint32_t>> squares = {};
+    ImageView source;
+    ImageView destination;
+    TileScheduler* scheduler = nullptr;
+    int workerIndex = 0;
     uint32_t squareSize = 0;
+    int radius = 4;
+    BlurMode mode = BlurMode::SlidingWindow;
+};
+
+struct Options {
+    int radius = 4;
+    BlurMode mode = BlurMode::SlidingWindow;
+    bool compareModes = false;
+    int tileSize = 128;
+    int benchmarkPassesCount = 0;
+    bool useMappedFiles = false;
+    bool countEvents = false;
+    Placement placement;
+    bool showTopology = false;
+    BenchmarkOptions benchmark;
 };
 
 // ==================== Blur Processing Functions ====================
 
-void ProcessPixel(uint32_t x, uint32_t y, int radius, Bitmap* bmp,
-    const unsigned char* blurredData, unsigned char* outputData) {
-    int width = bmp->getWidth();
-    int height = bmp->getHeight();
-    int channels = 3;
+// Channels (including alpha in 32-bit images) are averaged independently,
+// so the kernels work directly on the stored BGR(A) order and never reorder
+// them.
+void ProcessPixel(uint32_t x, uint32_t y, int radius, const ImageView& source,
+    const ImageView& output) {
+    int width = source.width;
+    int height = source.height;
+    int channels = source.bytesPerPixel;
 
-    int red = 0, green = 0, blue = 0;
+    int sums[4] = { 0, 0, 0, 0 };
     int count = 0;
 
     for (int dy = -radius; dy <= radius; dy++) {
@@ -33,137 +67,264 @@ void ProcessPixel(uint32_t x, uint32_t y, int radius, Bitmap* bmp,
             int newY = static_cast<int>(y) + dy;
 
             if (newX >= 0 && newX < width && newY >= 0 && newY < height) {
-                size_t index = (static_cast<size_t>(newY) * width + newX) * channels;
-                red += blurredData[index + 0];
-                green += blurredData[index + 1];
-                blue += blurredData[index + 2];
+                const uint8_t* pixel = source.pixel(newX, newY);
+                for (int c = 0; c < channels; c++) {
+                    sums[c] += pixel[c];
+                }
                 count++;
             }
         }
     }
 
     if (count > 0) {
-        size_t index = (static_cast<size_t>(y) * width + x) * channels;
-        outputData[index + 0] = static_cast<unsigned char>(blue / count);
-        outputData[index + 1] = static_cast<unsigned char>(green / count);
-        outputData[index + 2] = static_cast<unsigned char>(red / count);
+        uint8_t* pixel = output.pixel(x, y);
+        for (int c = 0; c < channels; c++) {
+            pixel[c] = static_cast<unsigned char>(sums[c] / count);
+        }
     }
 }
 
 void ProcessSquare(const pair<uint32_t, uint32_t>& square, uint32_t squareSize,
-    int radius, Bitmap* bmp, const unsigned char* blurredData,
-    unsigned char* outputData) {
-    int width = bmp->getWidth();
-    int height = bmp->getHeight();
-
+    int radius, const ImageView& source, const ImageView& output) {
     uint32_t startX = square.first;
     uint32_t startY = square.second;
-    uint32_t endX = min(startX + squareSize, static_cast<uint32_t>(width));
-    uint32_t endY = min(startY + squareSize, static_cast<uint32_t>(height));
+    uint32_t endX = min(startX + squareSize, static_cast<uint32_t>(source.width));
+    uint32_t endY = min(startY + squareSize, static_cast<uint32_t>(source.height));
 
     for (uint32_t y = startY; y < endY; y++) {
         for (uint32_t x = startX; x < endX; x++) {
-            ProcessPixel(x, y, radius, bmp, blurredData, outputData);
+            ProcessPixel(x, y, radius, source, output);
         }
     }
 }
 
-void Blur(int radius, Params* params) {
-    Bitmap* bmp = params->in;
-    int width = bmp->getWidth();
-    int height = bmp->getHeight();
-    unsigned char* data = const_cast<unsigned char*>(bmp->getData());
-
-    int channels = 3;
-    unsigned char* blurredData = new unsigned char[width * height * channels];
-    memcpy(blurredData, data, static_cast<size_t>(width) * height * channels);
-
-    for (const auto& square : params->squares) {
-        ProcessSquare(square, params->squareSize, radius, bmp, blurredData, data);
+// ==================== Sliding Window Blur Functions ====================
+
+// Sums every channel of row y over the clipped window [x - radius, x + radius]
+// for each x in [startX, endX). The window is primed once and then slid one
+// pixel at a time, so the cost per pixel does not depend on the radius. The
+// slide is split at the image edges so the interior loop has no bounds checks.
+void AccumulateRowSums(uint32_t y, uint32_t startX, uint32_t endX, int radius,
+    const ImageView& source, uint32_t* rowSums) {
+    int width = source.width;
+    int channels = source.bytesPerPixel;
+    const uint8_t* row = source.row(y);
+
+    uint32_t sums[4] = { 0, 0, 0, 0 };
+    int windowStart = max(0, static_cast<int>(startX) - radius);
+    int windowEnd = min(width - 1, static_cast<int>(startX) + radius);
+    for (int x = windowStart; x <= windowEnd; x++) {
+        for (int c = 0; c < channels; c++) {
+            sums[c] += row[x * channels + c];
+        }
     }
 
-    delete[] blurredData;
+    auto store = [&](int x) {
+        for (int c = 0; c < channels; c++) {
+            rowSums[(x - startX) * channels + c] = sums[c];
+        }
+    };
+    auto slide = [&](int x, bool hasEntering, bool hasLeaving) {
+        for (int c = 0; c < channels; c++) {
+            if (hasEntering) {
+                sums[c] += row[(x + radius) * channels + c];
+            }
+            if (hasLeaving) {
+                sums[c] -= row[(x - radius - 1) * channels + c];
+            }
+        }
+    };
+
+    // Leaving pixels exist from x = radius + 1 on, entering ones up to x = width - radius - 1
+    int first = static_cast<int>(startX);
+    int last = static_cast<int>(endX);
+    int interiorStart = clamp(radius + 1, first + 1, last);
+    int interiorEnd = clamp(width - radius, interiorStart, last);
+
+    store(first);
+    for (int x = first + 1; x < interiorStart; x++) {
+        slide(x, x + radius < width, x - radius - 1 >= 0);
+        store(x);
+    }
+    for (int x = interiorStart; x < interiorEnd; x++) {
+        slide(x, true, true);
+        store(x);
+    }
+    for (int x = interiorEnd; x < last; x++) {
+        slide(x, x + radius < width, x - radius - 1 >= 0);
+        store(x);
+    }
 }
 
-// ==================== Thread Management Functions ====================
+void ApplyRowSums(uint32_t y, uint32_t startX, uint32_t endX, int radius,
+    const ImageView& source, uint32_t* rowSums, uint32_t* columnSums, bool add) {
+    AccumulateRowSums(y, startX, endX, radius, source, rowSums);
 
-DWORD WINAPI ThreadProc(LPVOID lpParam) {
-    Params* params = static_cast<Params*>(lpParam);
-    Blur(4, params);
-    return 0;
+    size_t count = static_cast<size_t>(endX - startX) * source.bytesPerPixel;
+    for (size_t i = 0; i < count; i++) {
+        columnSums[i] = add ? columnSums[i] + rowSums[i] : columnSums[i] - rowSums[i];
+    }
 }
 
-HANDLE CreateThreadWithAffinity(Params* params, int threadIndex, int coresCount) {
-    HANDLE threadHandle = CreateThread(NULL, 0, &ThreadProc, params, CREATE_SUSPENDED, NULL);
+// Separable box blur of the rows [startY, startY + bandHeight): horizontal
+// running sums per row feed vertical running sums per column, so only one
+// row enters and one row leaves the window for every output row. The band
+// spans the whole width, so each row's window is primed once; only the 2r
+// halo rows above the band are summed again by the band above. Produces
+// the same bytes as ProcessSquare.
+void ProcessBandSlidingWindow(uint32_t startY, uint32_t bandHeight, int radius,
+    const ImageView& source, const ImageView& output) {
+    int width = source.width;
+    int height = source.height;
+    int channels = source.bytesPerPixel;
+
+    uint32_t startX = 0;
+    uint32_t endX = static_cast<uint32_t>(width);
+    uint32_t endY = min(startY + bandHeight, static_cast<uint32_t>(height));
+    if (startX >= endX || startY >= endY) {
+        return;
+    }
+
+    vector<uint32_t> rowSums(static_cast<size_t>(endX - startX) * channels);
+    vector<uint32_t> columnSums(rowSums.size(), 0);
 
-    if (threadHandle != NULL) {
-        DWORD_PTR affinityMask = (static_cast<DWORD_PTR>(1) << (threadIndex % coresCount));
-        SetThreadAffinityMask(threadHandle, affinityMask);
-        ResumeThread(threadHandle);
+    int windowStart = max(0, static_cast<int>(startY) - radius);
+    int windowEnd = min(height - 1, static_cast<int>(startY) + radius);
+    for (int y = windowStart; y <= windowEnd; y++) {
+        ApplyRowSums(y, startX, endX, radius, source, rowSums.data(), columnSums.data(), true);
     }
 
-    return threadHandle;
+    for (uint32_t y = startY; y < endY; y++) {
+        if (y > startY) {
+            int entering = static_cast<int>(y) + radius;
+            int leaving = static_cast<int>(y) - radius - 1;
+            if (entering < height) {
+                ApplyRowSums(entering, startX, endX, radius, source, rowSums.data(), columnSums.data(), true);
+            }
+            if (leaving >= 0) {
+                ApplyRowSums(leaving, startX, endX, radius, source, rowSums.data(), columnSums.data(), false);
+            }
+        }
+
+        uint32_t countY = min(height - 1, static_cast<int>(y) + radius) - max(0, static_cast<int>(y) - radius) + 1;
+        uint8_t* outputRow = output.row(y);
+
+        for (uint32_t x = startX; x < endX; x++) {
+            uint32_t countX = min(width - 1, static_cast<int>(x) + radius) - max(0, static_cast<int>(x) - radius) + 1;
+            uint32_t count = countX * countY;
+            const uint32_t* sums = &columnSums[(x - startX) * channels];
+
+            for (int c = 0; c < channels; c++) {
+                outputRow[x * channels + c] = static_cast<unsigned char>(sums[c] / count);
+            }
+        }
+    }
+}
+
+void Blur(int radius, Params* params) {
+    pair<uint32_t, uint32_t> square;
+    while (params->scheduler->Next(params->workerIndex, square)) {
+        if (params->mode == BlurMode::Reference) {
+            ProcessSquare(square, params->squareSize, radius, params->source, params->destination);
+        }
+        else {
+            ProcessBandSlidingWindow(square.second, params->squareSize, radius, params->source, params->destination);
+        }
+    }
 }
 
-void WaitForAllThreads(HANDLE* handles, int threadsCount) {
-    WaitForMultipleObjects(static_cast<DWORD>(threadsCount), handles, TRUE, INFINITE);
+// ==================== Thread Management Functions ====================
+
+void ThreadProc(Params* params) {
+    Blur(params->radius, params);
 }
 
-void CleanupThreadResources(HANDLE* handles, Params* params, int threadsCount) {
-    for (int i = 0; i < threadsCount; i++) {
-        if (handles[i] != NULL) {
-            CloseHandle(handles[i]);
+// Per-pass cost of an empty job: a fresh set of pinned threads per pass, as
+// Run used to do, versus handing the job to the persistent pool.
+void BenchmarkPassOverhead(const vector<int>& cpus, int passes) {
+    int threadsCount = static_cast<int>(cpus.size());
+    auto spawnStart = chrono::high_resolution_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        vector<thread> threads;
+        for (int cpu : cpus) {
+            threads.emplace_back([cpu]() { PinCurrentThread(cpu); });
+        }
+        for (auto& worker : threads) {
+            worker.join();
         }
     }
-    delete[] handles;
-    delete[] params;
+    auto spawnEnd = chrono::high_resolution_clock::now();
+
+    WorkerPool pool(cpus);
+    auto poolStart = chrono::high_resolution_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+        pool.Run([](int) {});
+    }
+    auto poolEnd = chrono::high_resolution_clock::now();
+
+    auto spawnMicroseconds = chrono::duration<double, micro>(spawnEnd - spawnStart).count() / passes;
+    auto poolMicroseconds = chrono::duration<double, micro>(poolEnd - poolStart).count() / passes;
+
+    cout << "Per-pass overhead over " << passes << " passes with " << threadsCount << " threads:" << endl;
+    cout << "Thread per pass: " << spawnMicroseconds << " us" << endl;
+    cout << "Persistent pool: " << poolMicroseconds << " us" << endl;
 }
 
 // ==================== Work Distribution Functions ====================
 
-vector<pair<uint32_t, uint32_t>> GenerateAllSquares(int width, int height, int gridSize) {
-    uint32_t squareWidth = static_cast<uint32_t>((width + gridSize - 1) / gridSize);
-    uint32_t squareHeight = static_cast<uint32_t>((height + gridSize - 1) / gridSize);
-
+// Tiles are squareSize x squareSize in row-major order. The size is fixed by
+// the options rather than the thread count, so every worker sees many tiles
+// and the scheduler has something to balance.
+vector<pair<uint32_t, uint32_t>> GenerateAllSquares(int width, int height, uint32_t squareSize) {
     vector<pair<uint32_t, uint32_t>> allSquares;
 
-    for (int row = 0; row < gridSize; row++) {
-        for (int col = 0; col < gridSize; col++) {
-            uint32_t startX = col * squareWidth;
-            uint32_t startY = row * squareHeight;
-
-            if (startX < static_cast<uint32_t>(width) && startY < static_cast<uint32_t>(height)) {
-                allSquares.push_back({ startX, startY });
-            }
+    for (uint32_t startY = 0; startY < static_cast<uint32_t>(height); startY += squareSize) {
+        for (uint32_t startX = 0; startX < static_cast<uint32_t>(width); startX += squareSize) {
+            allSquares.push_back({ startX, startY });
         }
     }
 
     return allSquares;
 }
 
-void ShuffleSquares(vector<pair<uint32_t, uint32_t>>& squares) {
-    random_device rd;
-    mt19937 g(rd());
-    shuffle(squares.begin(), squares.end(), g);
+// Full-width bands bandHeight rows high, top to bottom.
+vector<pair<uint32_t, uint32_t>> GenerateAllBands(int height, uint32_t bandHeight) {
+    vector<pair<uint32_t, uint32_t>> allBands;
+
+    for (uint32_t startY = 0; startY < static_cast<uint32_t>(height); startY += bandHeight) {
+        allBands.push_back({ 0, startY });
+    }
+
+    return allBands;
 }
 
-Params* DistributeWorkAmongThreads(const vector<pair<uint32_t, uint32_t>>& allSquares,
-    Bitmap* bmp, uint32_t squareSize, int threadsCount) {
-    Params* paramsArray = new Params[threadsCount];
-    int squaresPerThread = static_cast<int>(allSquares.size()) / threadsCount;
-    int remainingSquares = static_cast<int>(allSquares.size()) % threadsCount;
+// Band height for the sliding window: --tile rows, but at least 8 * radius,
+// so re-summing the halo rows of each band adds at most a quarter to the
+// work however large the radius. Large radii mean fewer bands to balance.
+uint32_t SelectBandHeight(uint32_t tileSize, int radius) {
+    return max(tileSize, static_cast<uint32_t>(8 * radius));
+}
+
+vector<Params> DistributeWorkAmongThreads(TileScheduler* scheduler, const ImageView& source,
+    const ImageView& destination, uint32_t squareSize, int threadsCount, const Options& options) {
+    if (options.mode == BlurMode::SlidingWindow) {
+        squareSize = SelectBandHeight(squareSize, options.radius);
+        scheduler->Reset(GenerateAllBands(source.height, squareSize));
+    }
+    else {
+        scheduler->Reset(GenerateAllSquares(source.width, source.height, squareSize));
+    }
 
-    size_t squareIndex = 0;
+    vector<Params> paramsArray(threadsCount);
 
     for (int i = 0; i < threadsCount; i++) {
-        paramsArray[i].in = bmp;
+        paramsArray[i].source = source;
+        paramsArray[i].destination = destination;
+        paramsArray[i].scheduler = scheduler;
+        paramsArray[i].workerIndex = i;
         paramsArray[i].squareSize = squareSize;
-
-        int currentSquares = squaresPerThread + (i < remainingSquares ? 1 : 0);
-
-        for (int j = 0; j < currentSquares && squareIndex < allSquares.size(); j++) {
-            paramsArray[i].squares.push_back(allSquares[squareIndex++]);
-        }
+        paramsArray[i].radius = options.radius;
+        paramsArray[i].mode = options.mode;
     }
 
     return paramsArray;
@@ -171,34 +332,158 @@ Params* DistributeWorkAmongThreads(const vector<pair<uint32_t, uint32_t>>& allSq
 
 // ==================== Main Orchestration Functions ====================
 
-void Run(Bitmap* bmp, int threadsCount, int coresCount) {
-    int width = bmp->getWidth();
-    int height = bmp->getHeight();
-
-    vector<pair<uint32_t, uint32_t>> allSquares = GenerateAllSquares(width, height, threadsCount);
-    ShuffleSquares(allSquares);
+// Blurs source into destination. Both images must have the same dimensions
+// and the scheduler must have as many workers as the pool. With counters,
+// every worker counts its own share of the pass into its row.
+void Run(WorkerPool* pool, const ImageView& source, const ImageView& destination,
+    const Options& options, TileScheduler* scheduler, PerfReport* counters = nullptr) {
+    vector<Params> paramsArray = DistributeWorkAmongThreads(scheduler, source, destination,
+        static_cast<uint32_t>(options.tileSize), pool->getThreadsCount(), options);
+
+    if (!counters) {
+        pool->Run([&paramsArray](int workerIndex) { ThreadProc(&paramsArray[workerIndex]); });
+        return;
+    }
 
-    uint32_t squareWidth = static_cast<uint32_t>((width + threadsCount - 1) / threadsCount);
-    uint32_t squareHeight = static_cast<uint32_t>((height + threadsCount - 1) / threadsCount);
-    uint32_t squareSize = max(squareWidth, squareHeight);
+    pool->Run([&paramsArray, counters](int workerIndex) {
+        PerfCounters workerCounters;
+        workerCounters.Start();
+        ThreadProc(&paramsArray[workerIndex]);
+        counters->Add(workerIndex, workerCounters);
+    });
+}
 
-    Params* paramsArray = DistributeWorkAmongThreads(allSquares, bmp, squareSize, threadsCount);
+// Blurs source into target under the benchmark harness. As many passes as
+// the harness asks for are stacked: the first reads source, and each later
+// one reads the previous result, ping-ponging between target and a scratch
+// buffer. Whichever of the two holds the last pass is copied into target
+// once timing is over. Counters, if asked for, come from one extra pass so
+// the timed ones stay uninstrumented.
+BenchmarkResult BlurImage(Benchmark* harness, WorkerPool* pool, TileScheduler* scheduler,
+    const ImageView& source, const ImageView& target, const Options& options) {
+    ptrdiff_t stride = abs(target.stride);
+    vector<uint8_t> scratchData(static_cast<size_t>(stride) * target.height);
+    ImageView scratch = { scratchData.data(), target.width, target.height, target.bytesPerPixel, stride };
+
+    ImageView input = source;
+    ImageView output = target;
+    int passesCount = 0;
+    auto blurPass = [&](PerfReport* counters) {
+        Run(pool, input, output, options, scheduler, counters);
+        input = output;
+        output = (output.data == target.data) ? scratch : target;
+        passesCount++;
+    };
+
+    BenchmarkResult timing = harness->Run("blur", [&]() { blurPass(nullptr); });
+
+    if (options.countEvents) {
+        PerfReport counters(pool->getThreadsCount());
+        blurPass(&counters);
+        counters.Print(cout, "Counters for one pass");
+    }
 
-    HANDLE* handles = new HANDLE[threadsCount];
-    for (int i = 0; i < threadsCount; i++) {
-        handles[i] = CreateThreadWithAffinity(&paramsArray[i], i, coresCount);
+    if (input.data != target.data) {
+        size_t rowBytes = static_cast<size_t>(target.width) * target.bytesPerPixel;
+        for (int y = 0; y < target.height; y++) {
+            memcpy(target.row(y), input.row(y), rowBytes);
+        }
     }
+    cout << "Applied blur " << passesCount << " times" << endl;
 
-    WaitForAllThreads(handles, threadsCount);
-    CleanupThreadResources(handles, paramsArray, threadsCount);
+    return timing;
 }
 
 // ==================== Utility & Validation Functions ====================
 
+void PrintUsage(const char* programName) {
+    cout << "Usage: " << programName << " <input.bmp> <threads_count> <cores_count>"
+        << " [--radius=N] [--mode=sliding|reference|compare] [--tile=N] [--bench-pool[=passes]] [--mmap] [--perf]"
+        << " [--placement=linear|compact|scatter|physical|numa[:node]] [--topology] "
+        << BenchmarkOptions::getUsage() << endl;
+    cout << "--tile=N: the reference kernel works on N x N tiles; the sliding window (default) on full-width"
+        << " bands of max(N, 8 * radius) rows. Its cost per pixel is then nearly independent of the radius: the"
+        << " halo rows each band sums again add at most a quarter." << endl;
+}
+
+bool ParseOptions(int argc, char* argv[], Options& options) {
+    for (int i = 4; i < argc; i++) {
+        string arg = argv[i];
+
+        if (arg.rfind("--radius=", 0) == 0) {
+            options.radius = atoi(arg.c_str() + strlen("--radius="));
+            if (options.radius <= 0) {
+                cout << "Radius must be positive" << endl;
+                return false;
+            }
+        }
+        else if (arg.rfind("--tile=", 0) == 0) {
+            options.tileSize = atoi(arg.c_str() + strlen("--tile="));
+            if (options.tileSize <= 0) {
+                cout << "Tile size must be positive" << endl;
+                return false;
+            }
+        }
+        else if (arg == "--bench-pool") {
+            options.benchmarkPassesCount = 1000;
+        }
+        else if (arg.rfind("--bench-pool=", 0) == 0) {
+            options.benchmarkPassesCount = atoi(arg.c_str() + strlen("--bench-pool="));
+            if (options.benchmarkPassesCount <= 0) {
+                cout << "Benchmark passes count must be positive" << endl;
+                return false;
+            }
+        }
+        else if (arg == "--mmap") {
+            options.useMappedFiles = true;
+        }
+        else if (arg == "--perf") {
+            options.countEvents = true;
+        }
+        else if (arg.rfind("--placement=", 0) == 0) {
+            try {
+                options.placement = Placement::Parse(arg.substr(strlen("--placement=")));
+            }
+            catch (const exception& error) {
+                cout << error.what() << endl;
+                return false;
+            }
+        }
+        else if (arg == "--topology") {
+            options.showTopology = true;
+        }
+        else if (arg == "--mode=sliding") {
+            options.mode = BlurMode::SlidingWindow;
+        }
+        else if (arg == "--mode=reference") {
+            options.mode = BlurMode::Reference;
+        }
+        else if (arg == "--mode=compare") {
+            options.compareModes = true;
+        }
+        else if (options.benchmark.ParseFlag(arg)) {
+        }
+        else {
+            cout << "Unknown option: " << arg << endl;
+            PrintUsage(argv[0]);
+            return false;
+        }
+    }
+
+    // The comparison blurs private copies of an in-memory image
+    if (options.compareModes && options.useMappedFiles) {
+        cout << "--mode=compare cannot be combined with --mmap" << endl;
+        PrintUsage(argv[0]);
+        return false;
+    }
+
+    return true;
+}
+
 bool ValidateArguments(int argc, char* argv[]) {
-    if (argc != 4) {
+    if (argc < 4) {
         cout << "Args count error\n";
-        cout << "Usage: " << argv[0] << " <input.bmp> <threads_count> <cores_count>" << endl;
+        PrintUsage(argv[0]);
         return false;
     }
 
@@ -218,25 +503,73 @@ bool ValidateArguments(int argc, char* argv[]) {
     return true;
 }
 
-int CalculateIterations(chrono::milliseconds testDuration) {
-    if (testDuration.count() < 500) {
-        return max(2, 500 / max(1, static_cast<int>(testDuration.count())));
+// Blurs the whole image single-threaded with both kernels and reports
+// timings and any byte that differs between them.
+bool CompareBlurModes(Benchmark* harness, Bitmap& bmp, int radius) {
+    Bitmap reference = bmp;
+    Bitmap sliding = bmp;
+
+    TileScheduler scheduler(1);
+
+    Params params;
+    params.source = bmp.view();
+    params.scheduler = &scheduler;
+    params.squareSize = static_cast<uint32_t>(max(bmp.getWidth(), bmp.getHeight()));
+    params.radius = radius;
+
+    auto blurWhole = [&params, &scheduler, radius]() {
+        scheduler.Reset({ { 0, 0 } });
+        Blur(radius, &params);
+    };
+
+    params.destination = reference.view();
+    params.mode = BlurMode::Reference;
+    BenchmarkResult referenceTiming = harness->Run("reference", blurWhole);
+
+    params.destination = sliding.view();
+    params.mode = BlurMode::SlidingWindow;
+    BenchmarkResult slidingTiming = harness->Run("sliding", blurWhole);
+
+    size_t rowBytes = static_cast<size_t>(bmp.getWidth()) * bmp.view().bytesPerPixel;
+    size_t mismatches = 0;
+    int maxDifference = 0;
+    for (int y = 0; y < bmp.getHeight(); y++) {
+        const uint8_t* referenceRow = reference.view().row(y);
+        const uint8_t* slidingRow = sliding.view().row(y);
+        for (size_t i = 0; i < rowBytes; i++) {
+            int difference = abs(referenceRow[i] - slidingRow[i]);
+            if (difference != 0) {
+                mismatches++;
+                maxDifference = max(maxDifference, difference);
+            }
+        }
     }
-    return 1;
+
+    cout << "Radius " << radius << ":" << endl;
+    cout << "Reference: " << Benchmark::FormatSummary(referenceTiming) << endl;
+    cout << "Sliding: " << Benchmark::FormatSummary(slidingTiming) << endl;
+    cout << "Mismatched bytes: " << mismatches << " (max difference " << maxDifference << ")" << endl;
+
+    return mismatches == 0;
 }
 
-void PrintResults(chrono::milliseconds totalDuration, int iterations) {
+void PrintResults(chrono::milliseconds totalDuration, const BenchmarkResult& blurTiming) {
     cout << "Total execution time: " << totalDuration.count() << " ms" << endl;
-    if (iterations > 1) {
-        cout << "Applied blur " << iterations << " times" << endl;
-        cout << "Average time per blur: " << totalDuration.count() / iterations << " ms" << endl;
+    cout << "Blur: " << Benchmark::FormatSummary(blurTiming) << endl;
+}
+
+void PrintSchedulerStats(const TileScheduler& scheduler) {
+    for (int i = 0; i < scheduler.getWorkersCount(); i++) {
+        const TileScheduler::WorkerStats& stats = scheduler.getStats(i);
+        cout << "Worker " << i << ": " << stats.tilesProcessed << " tiles, "
+            << stats.steals << " steals" << endl;
     }
 }
 
 // ==================== Main Function ====================
 
 int main(int argc, char* argv[]) {
-    auto startTime = chrono::high_resolution_clock::now();
+    auto startTime = chrono::steady_clock::now();
 
     if (!ValidateArguments(argc, argv)) {
         return 1;
@@ -246,36 +579,75 @@ int main(int argc, char* argv[]) {
     int threadsCount = atoi(argv[2]);
     int coresCount = atoi(argv[3]);
 
-    Bitmap bmp;
-    if (!bmp.open(imageName)) {
-        cout << "Failed to open image: " << imageName << endl;
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
         return 1;
     }
 
-    int iterations = 1;
-    auto testStart = chrono::high_resolution_clock::now();
-    Run(&bmp, threadsCount, coresCount);
-    auto testEnd = chrono::high_resolution_clock::now();
+    // cores_count keeps the first N CPUs of the placement order; with the
+    // default linear order worker i lands on CPU i % cores_count.
+    CpuTopology topology = CpuTopology::Detect();
+    vector<int> cpus;
+    try {
+        cpus = PlanPlacement(topology, options.placement, threadsCount, coresCount);
+    }
+    catch (const exception& error) {
+        cout << error.what() << endl;
+        return 1;
+    }
+    if (options.showTopology) {
+        cout << "Topology: " << topology.Describe() << endl;
+        cout << "Placement " << options.placement.getName() << ": CPUs " << FormatCpuList(cpus) << endl;
+    }
 
-    auto testDuration = chrono::duration_cast<chrono::milliseconds>(testEnd - testStart);
-    iterations = CalculateIterations(testDuration);
+    if (options.benchmarkPassesCount > 0) {
+        BenchmarkPassOverhead(cpus, options.benchmarkPassesCount);
+        return 0;
+    }
 
-    if (iterations > 1) {
-        cout << "Execution too fast (" << testDuration.count() << "ms), applying blur "
-            << iterations << " times" << endl;
+    TileScheduler scheduler(threadsCount);
+    WorkerPool pool(cpus);
 
-        bmp.open(imageName);
-        for (int i = 0; i < iterations; i++) {
-            Run(&bmp, threadsCount, coresCount);
+    string newImageName = string(imageName) + "Blured.bmp";
+    Benchmark harness(options.benchmark);
+    BenchmarkResult blurTiming;
+
+    if (options.useMappedFiles) {
+        // Both images stay in the page cache; the blurred rows are written
+        // straight into the mapped output file.
+        try {
+            MappedBitmap input = MappedBitmap::Open(imageName);
+            MappedBitmap output = MappedBitmap::CreateLike(newImageName, input);
+            blurTiming = BlurImage(&harness, &pool, &scheduler, input.view(), output.view(), options);
+        }
+        catch (const exception& error) {
+            cout << error.what() << endl;
+            return 1;
         }
     }
+    else {
+        Bitmap bmp;
+        if (!bmp.open(imageName)) {
+            cout << "Failed to open image: " << imageName << endl;
+            return 1;
+        }
 
-    string newImageName = string(imageName) + "Blured.bmp";
-    bmp.Save(newImageName.c_str());
+        if (options.compareModes) {
+            bool identical = CompareBlurModes(&harness, bmp, options.radius);
+            harness.WriteReports();
+            return identical ? 0 : 1;
+        }
 
-    auto endTime = chrono::high_resolution_clock::now();
+        Bitmap blurred = bmp;
+        blurTiming = BlurImage(&harness, &pool, &scheduler, bmp.view(), blurred.view(), options);
+        blurred.Save(newImageName.c_str());
+    }
+
+    auto endTime = chrono::steady_clock::now();
     auto totalDuration = chrono::duration_cast<chrono::milliseconds>(endTime - startTime);
-    PrintResults(totalDuration, iterations);
+    PrintResults(totalDuration, blurTiming);
+    PrintSchedulerStats(scheduler);
+    harness.WriteReports();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Hands out image tiles to a fixed set of workers. Every worker owns a deque
+// seeded with a contiguous run of tiles; it takes tiles from the front of its
+// own deque and, once that is empty, steals from the back of the others, so a
+// slow or descheduled worker no longer holds up the whole pass.
+class TileScheduler {
+public:
+    using Tile = std::pair<uint32_t, uint32_t>;
+
+    struct WorkerStats {
+        uint64_t tilesProcessed = 0;
+        uint64_t steals = 0;
+    };
+
+    explicit TileScheduler(int workersCount) {
+        for (int i = 0; i < workersCount; i++) {
+            queues.push_back(std::make_unique<WorkerQueue>());
+        }
+    }
+
+    int getWorkersCount() const {
+        return static_cast<int>(queues.size());
+    }
+
+    // Splits tiles into contiguous runs, one per worker. Must not be called
+    // while workers are taking tiles.
+    void Reset(const std::vector<Tile>& tiles) {
+        size_t workersCount = queues.size();
+        size_t tilesPerWorker = tiles.size() / workersCount;
+        size_t remainingTiles = tiles.size() % workersCount;
+
+        size_t tileIndex = 0;
+        for (size_t i = 0; i < workersCount; i++) {
+            size_t currentTiles = tilesPerWorker + (i < remainingTiles ? 1 : 0);
+            queues[i]->tiles.assign(tiles.begin() + tileIndex, tiles.begin() + tileIndex + currentTiles);
+            tileIndex += currentTiles;
+        }
+    }
+
+    // Returns false once every deque is empty.
+    bool Next(int worker, Tile& tile) {
+        WorkerQueue& own = *queues[worker];
+        {
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tiles.empty()) {
+                tile = own.tiles.front();
+                own.tiles.pop_front();
+                own.stats.tilesProcessed++;
+                return true;
+            }
+        }
+
+        int workersCount = getWorkersCount();
+        for (int i = 1; i < workersCount; i++) {
+            WorkerQueue& victim = *queues[(worker + i) % workersCount];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tiles.empty()) {
+                tile = victim.tiles.back();
+                victim.tiles.pop_back();
+                own.stats.tilesProcessed++;
+                own.stats.steals++;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Totals since construction. Only meaningful between passes.
+    const WorkerStats& getStats(int worker) const {
+        return queues[worker]->stats;
+    }
+
+private:
+    // Stats are only written by the owning worker, so they live outside the lock.
+    struct alignas(64) WorkerQueue {
+        std::mutex lock;
+        std::deque<Tile> tiles;
+        WorkerStats stats;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+};
@@ -0,0 +1,70 @@
+#pragma once
+#include <barrier>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "../../common/ThreadAffinity.h"
+
+// Long-lived set of pinned workers. Threads are created once; every Run
+// releases them through a start barrier, lets each execute the job with its
+// own index and returns once all of them have reached the finish barrier.
+class WorkerPool {
+public:
+    using Job = std::function<void(int workerIndex)>;
+
+    // One worker per entry of cpus, pinned to that logical CPU for its
+    // whole lifetime; see PlanPlacement.
+    explicit WorkerPool(const std::vector<int>& cpus)
+        : startBarrier(static_cast<std::ptrdiff_t>(cpus.size()) + 1),
+        finishBarrier(static_cast<std::ptrdiff_t>(cpus.size()) + 1) {
+        for (size_t i = 0; i < cpus.size(); i++) {
+            threads.emplace_back(&WorkerPool::WorkerLoop, this, static_cast<int>(i), cpus[i]);
+        }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+        stopping = true;
+        startBarrier.arrive_and_wait();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    int getThreadsCount() const {
+        return static_cast<int>(threads.size());
+    }
+
+    // Not reentrant: only the thread that owns the pool may call Run.
+    void Run(const Job& job) {
+        currentJob = &job;
+        startBarrier.arrive_and_wait();
+        finishBarrier.arrive_and_wait();
+        currentJob = nullptr;
+    }
+
+private:
+    // currentJob and stopping are published by the start barrier.
+    void WorkerLoop(int workerIndex, int cpu) {
+        PinCurrentThread(cpu);
+
+        while (true) {
+            startBarrier.arrive_and_wait();
+            if (stopping) {
+                return;
+            }
+
+            (*currentJob)(workerIndex);
+            finishBarrier.arrive_and_wait();
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::barrier<> startBarrier;
+    std::barrier<> finishBarrier;
+    const Job* currentJob = nullptr;
+    bool stopping = false;
+};
@@ -1,18 +1,13 @@
 #include <iostream>
 #include <memory>
 #include <vector>
-#include <windows.h>
-#include <mmsystem.h>
 #include <fstream>
 #include <sstream>
 #include <cmath>
+#include <system_error>
+#include "../../common/Threading.h"
 
-#pragma comment(lib, "winmm.lib")
-
-DWORD WINAPI MyThreadFunction(LPVOID lpParam) {
-    auto threadNumPtr = std::unique_ptr<int>(static_cast<int*>(lpParam));
-    const int threadNum = *threadNumPtr;
-
+int MyThreadFunction(const int threadNum) {
     std::ostringstream filename;
     filename << "thread_" << threadNum << ".txt";
     std::ofstream outFile(filename.str());
@@ -23,7 +18,7 @@ DWORD WINAPI MyThreadFunction(LPVOID lpParam) {
     }
 
     for (int i = 0; i < 21; ++i) {
-        DWORD currentTime = timeGetTime();
+        uint64_t currentTime = MonotonicMilliseconds();
         output << threadNum << "|" << currentTime << "\n";
         for (int j = 0; j < 1'000'000; ++j) {
             for (int k = 0; k < 1'000; ++k) {
@@ -38,8 +33,10 @@ DWORD WINAPI MyThreadFunction(LPVOID lpParam) {
 }
 
 int main(const int argc, char* argv[]) {
+#ifdef _WIN32
     SetConsoleCP(1251);
     SetConsoleOutputCP(1251);
+#endif
 
     if (argc < 2 || argc > 3) {
         std::cerr << ": " << argv[0] << " <_> [__]" << "\n";
@@ -83,42 +80,34 @@ int main(const int argc, char* argv[]) {
         }
     }
 
-    std::vector<HANDLE> threads(numThreads);
+    std::vector<Thread> threads;
+    threads.reserve(numThreads);
 
     for (int i = 0; i < numThreads; ++i) {
-        auto threadNum = std::make_unique<int>(i + 1);
-        threads[i] = CreateThread(nullptr, 0, MyThreadFunction, threadNum.release(), CREATE_SUSPENDED, nullptr);
-
-        if (threads[i] == nullptr) {
-            std::cerr << ":    " << i + 1 << "\n";
-            threadNum.reset();
+        const int threadNum = i + 1;
+        try {
+            threads.emplace_back([threadNum]() { MyThreadFunction(threadNum); }, true);
+        }
+        catch (const std::system_error&) {
+            std::cerr << ":    " << threadNum << "\n";
             return 1;
         }
 
-        if (priorityThreadNum == i + 1 && !SetThreadPriority(threads[i], THREAD_PRIORITY_HIGHEST)) {
-            std::cerr << ":      " << i + 1 << "\n";
-        }
-        else {
-            if (!SetThreadPriority(threads[i], THREAD_PRIORITY_NORMAL)) {
-                std::cerr << ":      " << i + 1 << "\n";
-            }
+        const ThreadPriority priority = priorityThreadNum == threadNum ? ThreadPriority::Highest : ThreadPriority::Normal;
+        if (!threads[i].SetPriority(priority)) {
+            std::cerr << ":      " << threadNum << "\n";
         }
     }
 
     std::cout << " Enter  ..." << "\n";
     std::cin.get();
 
-    for (const HANDLE& thread : threads) {
-        if (ResumeThread(thread) == static_cast<DWORD>(-1)) {
-            std::cerr << ":   " << "\n";
-            return 1;
-        }
+    for (Thread& thread : threads) {
+        thread.Resume();
     }
 
-    WaitForMultipleObjects(numThreads, threads.data(), TRUE, INFINITE);
-
-    for (const HANDLE& thread : threads) {
-        CloseHandle(thread);
+    for (Thread& thread : threads) {
+        thread.Join();
     }
 
     return 0;
@@ -1,51 +1,53 @@
 #pragma once
-#include <chrono>
 #include <cmath>
 #include <cstdint>
 #include <string>
 #include <fstream>
 #include <vector>
-#include <windows.h>
 #include <iostream>
-#include <format>
+#include <sstream>
 #include <stdexcept>
 #include <algorithm>
-
-#pragma pack(push, 1)
-
-struct BMPFileHeader {
-    uint16_t fileType;
-    uint32_t fileSize;
-    uint16_t reserved1;
-    uint16_t reserved2;
-    uint32_t offsetData;
+#include <memory>
+#include "../../common/Image.h"
+#include "../../common/MappedBitmap.h"
+#include "../../common/PerfCounters.h"
+#include "../../common/Threading.h"
+#include "GaussianKernels.h"
+#include "SeparableGaussian.h"
+#include "TraceBuffer.h"
+
+// Padding- and orientation-aware model shared with the other image labs.
+using BMPImage = Image;
+
+struct BlurOptions {
+    GaussianKernels::Isa isa = GaussianKernels::Isa::Auto;
+    // Zero keeps the fixed 3x3 kernel; any positive value switches to the
+    // separable filter with a kernel radius of ceil(3 * sigma).
+    double sigma = 0.0;
+    // Columns per strip; zero sizes the separable filter's strips to
+    // STRIP_CACHE_BYTES and gives the 3x3 kernel whole rows.
+    int stripWidth = 0;
+    // Logical CPU for worker i, from PlanPlacement; empty leaves the workers
+    // wherever the scheduler puts them.
+    std::vector<int> threadCpus;
 };
 
-struct BMPInfoHeader {
-    uint32_t size;
-    int32_t width;
-    int32_t height;
-    uint16_t planes;
-    uint16_t bitCount;
-    uint32_t compression;
-    uint32_t sizeImage;
-    int32_t xPixelsPerMeter;
-    int32_t yPixelsPerMeter;
-    uint32_t colorsUsed;
-    uint32_t colorsImportant;
-};
-
-#pragma pack(pop)
-
-struct BMPImage {
-    BMPFileHeader fileHeader{};
-    BMPInfoHeader infoHeader{};
-    std::vector<uint8_t> pixelData;
+// Per-thread progress records of one blur, from ImageProcessor::CreateTrace.
+// Owned by the caller, so the buffers are allocated and the files written
+// outside whatever it times.
+struct BlurTrace {
+    std::vector<TraceBuffer> buffers;
+    int64_t startNs = 0;
 };
 
 class ImageProcessor {
 private:
     static constexpr int KERNEL_SIZE = 3;
+    // Per-worker working set a strip is sized to: a typical L2 slice.
+    static constexpr size_t STRIP_CACHE_BYTES = 256 * 1024;
+    // Traced blurs record every this many rows
+    static constexpr int TRACE_SAMPLING_RATE = 10;
     static constexpr double GAUSSIAN_KERNEL[3][3] = {
         {1.0, 2.0, 1.0},
         {2.0, 4.0, 2.0},
@@ -54,78 +56,37 @@ private:
 
 public:
     static BMPImage LoadImage(const std::string& filePath) {
-        BMPImage bmpImage;
-
-        std::ifstream file(filePath, std::ios::binary);
-        if (!file) {
-            throw std::runtime_error("Cannot open file: " + filePath);
-        }
-
-        file.read(reinterpret_cast<char*>(&bmpImage.fileHeader), sizeof(bmpImage.fileHeader));
-
-        if (bmpImage.fileHeader.fileType != 0x4D42) {
-            throw std::runtime_error("Not a valid BMP file.");
-        }
-
-        file.read(reinterpret_cast<char*>(&bmpImage.infoHeader), sizeof(bmpImage.infoHeader));
-
-        if (bmpImage.infoHeader.sizeImage == 0) {
-            int rowSize = ((bmpImage.infoHeader.width * bmpImage.infoHeader.bitCount + 31) / 32) * 4;
-            bmpImage.infoHeader.sizeImage = rowSize * bmpImage.infoHeader.height;
-        }
-
-        bmpImage.pixelData.resize(bmpImage.infoHeader.sizeImage);
-        file.seekg(bmpImage.fileHeader.offsetData, std::ios::beg);
-        file.read(reinterpret_cast<char*>(bmpImage.pixelData.data()), bmpImage.infoHeader.sizeImage);
-
-        return bmpImage;
+        return BMPImage::LoadBmp(filePath);
     }
 
     static void SaveImage(const std::string& filePath, const BMPImage& bmpImage) {
-        std::ofstream file(filePath, std::ios::binary);
-
-        if (!file) {
-            throw std::runtime_error("Cannot open file: " + filePath);
-        }
-
-        file.write(reinterpret_cast<const char*>(&bmpImage.fileHeader), sizeof(bmpImage.fileHeader));
-        file.write(reinterpret_cast<const char*>(&bmpImage.infoHeader), sizeof(bmpImage.infoHeader));
-        file.write(reinterpret_cast<const char*>(bmpImage.pixelData.data()), bmpImage.pixelData.size());
+        bmpImage.SaveBmp(filePath);
     }
 
 private:
     struct ThreadContext {
-        int threadId;
-        BMPImage* sourceImage;
-        BMPImage* resultImage;
+        ImageView sourceImage;
+        ImageView resultImage;
+        GaussianKernels::RowFilter rowFilter;
+        const SeparableGaussian::Kernel* separableKernel;
+        int stripWidth;
         int startLine;
         int endLine;
-        std::ofstream* performanceLog;
-        HANDLE* syncLock;
-        std::chrono::time_point<std::chrono::high_resolution_clock>* timeReference;
+        // Null unless the caller passed a BlurTrace
+        TraceBuffer* trace;
         int samplingRate;
+        // Null unless the caller asked for hardware counters
+        PerfReport* counters;
+        size_t threadIndex;
     };
 
-    static void HeavyComputation() {
-        volatile double result = 0.0;
-        for (int i = 0; i < 50; ++i) {
-            result += std::sin(i * 0.1) * std::cos(i * 0.05);
-        }
-    }
-
-    static int CalculatePixelOffset(int x, int y, int width, int bytesPerPixel, int stride) {
-        return y * stride + x * bytesPerPixel;
-    }
-
     static bool IsValidCoordinate(int x, int y, int width, int height) {
         return x >= 0 && x < width && y >= 0 && y < height;
     }
 
-    static uint8_t ApplyGaussianFilter(int centerX, int centerY, const BMPImage* image, int channelOffset) {
-        const int width = image->infoHeader.width;
-        const int height = image->infoHeader.height;
-        const int bytesPerPixel = image->infoHeader.bitCount / 8;
-        const int stride = ((width * bytesPerPixel + 3) / 4) * 4;
+    static uint8_t ApplyGaussianFilter(int centerX, int centerY, const ImageView& image, int channelOffset) {
+        const int width = image.width;
+        const int height = image.height;
 
         double weightedSum = 0.0;
         double kernelSum = 0.0;
@@ -136,9 +97,8 @@ private:
                 const int sampleY = centerY + ky;
 
                 if (IsValidCoordinate(sampleX, sampleY, width, height)) {
-                    const int pixelIndex = CalculatePixelOffset(sampleX, sampleY, width, bytesPerPixel, stride);
                     const double weight = GAUSSIAN_KERNEL[ky + 1][kx + 1];
-                    weightedSum += image->pixelData[pixelIndex + channelOffset] * weight;
+                    weightedSum += image.pixel(sampleX, sampleY)[channelOffset] * weight;
                     kernelSum += weight;
                 }
             }
@@ -147,116 +107,262 @@ private:
         return static_cast<uint8_t>(std::clamp(weightedSum / kernelSum, 0.0, 255.0));
     }
 
-    static DWORD WINAPI ProcessImageSegment(LPVOID context) {
-        ThreadContext* data = static_cast<ThreadContext*>(context);
+    // Edge routine: handles any pixel, clipping the kernel at the borders.
+    static void FilterPixel(int x, int y, const ImageView& source, const ImageView& result) {
+        uint8_t* target = result.pixel(x, y);
 
-        const int width = data->sourceImage->infoHeader.width;
-        const int height = data->sourceImage->infoHeader.height;
-        const int bytesPerPixel = data->sourceImage->infoHeader.bitCount / 8;
-        const int stride = ((width * bytesPerPixel + 3) / 4) * 4;
+        target[0] = ApplyGaussianFilter(x, y, source, 0);
+        target[1] = ApplyGaussianFilter(x, y, source, 1);
+        target[2] = ApplyGaussianFilter(x, y, source, 2);
 
-        int processedLines = 0;
-        const int totalLines = data->endLine - data->startLine;
-
-        for (int y = data->startLine; y < data->endLine; ++y) {
-            for (int x = 0; x < width; ++x) {
-                const int targetIndex = CalculatePixelOffset(x, y, width, bytesPerPixel, stride);
-
-                data->resultImage->pixelData[targetIndex] =
-                    ApplyGaussianFilter(x, y, data->sourceImage, 0);
-                data->resultImage->pixelData[targetIndex + 1] =
-                    ApplyGaussianFilter(x, y, data->sourceImage, 1);
-                data->resultImage->pixelData[targetIndex + 2] =
-                    ApplyGaussianFilter(x, y, data->sourceImage, 2);
-            }
+        // Alpha is not filtered, only carried over
+        for (int channel = 3; channel < source.bytesPerPixel; ++channel) {
+            target[channel] = source.pixel(x, y)[channel];
+        }
+    }
+
+    static void RecordProgress(const ThreadContext& data, int y, int& processedLines) {
+        processedLines++;
+
+        if (data.trace && processedLines % data.samplingRate == 0) {
+            data.trace->Record(y);
+        }
+    }
+
+    // Filters the columns [stripStart, stripEnd) of the band with the 3x3 kernel.
+    static void ProcessStrip3x3(const ThreadContext& data, int stripStart, int stripEnd, int& processedLines) {
+        const ImageView& source = data.sourceImage;
+        const ImageView& result = data.resultImage;
+        const int width = source.width;
+        const int height = source.height;
+        const int bytesPerPixel = source.bytesPerPixel;
 
-            processedLines++;
+        // Columns the row filter may handle: it needs a neighbour on each side
+        const int interiorStart = std::max(stripStart, 1);
+        const int interiorEnd = std::min(stripEnd, width - 1);
 
-            if (processedLines % data->samplingRate == 0) {
-                auto currentTimestamp = std::chrono::high_resolution_clock::now();
-                auto timeElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    currentTimestamp - *data->timeReference).count();
+        for (int y = data.startLine; y < data.endLine; ++y) {
+            const bool isInteriorRow = y > 0 && y < height - 1 && interiorStart < interiorEnd;
 
-                HeavyComputation();
+            if (data.rowFilter && isInteriorRow) {
+                const ptrdiff_t offset = static_cast<ptrdiff_t>(interiorStart - 1) * bytesPerPixel;
+                data.rowFilter(source.row(y - 1) + offset, source.row(y) + offset, source.row(y + 1) + offset,
+                    result.row(y) + offset, interiorEnd - interiorStart + 2, bytesPerPixel);
 
-                WaitForSingleObject(*data->syncLock, INFINITE);
-                *data->performanceLog << data->threadId << "\t" << timeElapsed << "\n";
-                ReleaseSemaphore(*data->syncLock, 1, nullptr);
+                for (int x = stripStart; x < interiorStart; ++x) {
+                    FilterPixel(x, y, source, result);
+                }
+                for (int x = interiorEnd; x < stripEnd; ++x) {
+                    FilterPixel(x, y, source, result);
+                }
+            }
+            else {
+                for (int x = stripStart; x < stripEnd; ++x) {
+                    FilterPixel(x, y, source, result);
+                }
             }
+
+            RecordProgress(data, y, processedLines);
         }
+    }
 
-        return 0;
+    static void ProcessStripSeparable(const ThreadContext& data, int stripStart, int stripEnd, int& processedLines) {
+        // Allocated by the worker itself, so the ring lands on its own NUMA node
+        SeparableGaussian::RowFilter filter(data.sourceImage, *data.separableKernel, stripStart, stripEnd);
+
+        for (int y = data.startLine; y < data.endLine; ++y) {
+            filter.ProcessRow(y, data.resultImage.row(y));
+            RecordProgress(data, y, processedLines);
+        }
     }
 
-public:
-    static BMPImage ApplyParallelBlur(BMPImage& sourceImage, const std::vector<int>& threadConfigurations) {
-        std::vector<std::ofstream> logFiles;
-        std::vector<std::string> filenames = { "performance_1.txt", "performance_2.txt", "performance_3.txt" };
+    // The band is cut into column strips, each walked top to bottom, so the
+    // halo rows a new output row needs were brought in for the previous one
+    // and every source byte comes from memory roughly once. Destination
+    // pages are first touched here, by the worker that owns the band.
+    static void ProcessImageSegment(ThreadContext* data) {
+        const int width = data->sourceImage.width;
+        int processedLines = 0;
+
+        PerfCounters counters;
+        if (data->counters) {
+            counters.Start();
+        }
+
+        for (int stripStart = 0; stripStart < width; stripStart += data->stripWidth) {
+            const int stripEnd = std::min(width, stripStart + data->stripWidth);
+
+            if (data->separableKernel) {
+                ProcessStripSeparable(*data, stripStart, stripEnd, processedLines);
+            }
+            else {
+                ProcessStrip3x3(*data, stripStart, stripEnd, processedLines);
+            }
+        }
+
+        if (data->counters) {
+            data->counters->Add(data->threadIndex, counters);
+        }
+    }
 
-        for (const auto& filename : filenames) {
-            logFiles.emplace_back(filename);
+    static int SelectStripWidth(const ImageView& image, const SeparableGaussian::Kernel* separableKernel,
+        const BlurOptions& options) {
+        if (options.stripWidth > 0) {
+            return options.stripWidth;
         }
 
-        HANDLE synchronizationLock = CreateSemaphore(nullptr, 1, 1, nullptr);
-        if (!synchronizationLock) {
-            throw std::runtime_error("Failed to create synchronization object");
+        // Only the separable filter is strip-mined by default: its ring of
+        // 2r+1 filtered rows outgrows L2 on wide images. The 3x3 kernel needs
+        // just three source rows and the output row, which fit in L2 for any
+        // image under ~20k pixels wide, so it keeps whole rows.
+        if (!separableKernel) {
+            return std::max(1, image.width);
         }
 
-        BMPImage processedImage = sourceImage;
-        std::vector<HANDLE> workerThreads(threadConfigurations.size());
+        const size_t columns = STRIP_CACHE_BYTES / SeparableGaussian::StripBytesPerColumn(*separableKernel);
+
+        // Keep strips a whole number of 64-pixel blocks so SIMD loops stay long
+        return static_cast<int>(std::max<size_t>(64, columns / 64 * 64));
+    }
+
+public:
+    static BMPImage ApplyParallelBlur(const BMPImage& sourceImage, const std::vector<int>& threadConfigurations,
+        const BlurOptions& options = BlurOptions()) {
+        BMPImage processedImage = BMPImage::CreateLike(sourceImage);
+        ApplyParallelBlur(sourceImage.view(), processedImage.view(), threadConfigurations, options);
+        return processedImage;
+    }
+
+    // Filters source into result, which must have the same layout. Either
+    // may be backed by a MappedBitmap, so the filter reads and writes the
+    // files in place. With counters, which must have a row per thread
+    // configuration, every worker adds what its hardware counters saw
+    // while it filtered its band. With trace, from CreateTrace for the same
+    // image, threads and options, every worker records its progress.
+    static void ApplyParallelBlur(const ImageView& sourceImage, const ImageView& processedImage,
+        const std::vector<int>& threadConfigurations, const BlurOptions& options = BlurOptions(),
+        PerfReport* counters = nullptr, BlurTrace* trace = nullptr) {
+        const GaussianKernels::RowFilter rowFilter = GaussianKernels::SelectRowFilter(options.isa);
+        const SeparableGaussian::Kernel* separableKernel =
+            options.sigma > 0.0 ? &SeparableGaussian::GetKernel(options.sigma) : nullptr;
+        const int stripWidth = SelectStripWidth(sourceImage, separableKernel, options);
+
+        std::vector<Thread> workerThreads;
+        workerThreads.reserve(threadConfigurations.size());
         std::vector<ThreadContext> threadContexts(threadConfigurations.size());
 
-        const int linesPerSegment = sourceImage.infoHeader.height / static_cast<int>(threadConfigurations.size());
-        auto globalStartTime = std::chrono::high_resolution_clock::now();
+        const int linesPerSegment = sourceImage.height / static_cast<int>(threadConfigurations.size());
+        if (trace) {
+            trace->startNs = MonotonicNanoseconds();
+        }
 
-        std::vector<int> threadIdentifiers(threadConfigurations.size());
         for (size_t i = 0; i < threadConfigurations.size(); ++i) {
-            threadIdentifiers[i] = static_cast<int>(i) + 1;
-
             const int segmentStart = static_cast<int>(i) * linesPerSegment;
             const int segmentEnd = (i == threadConfigurations.size() - 1) ?
-                sourceImage.infoHeader.height : segmentStart + linesPerSegment;
+                sourceImage.height : segmentStart + linesPerSegment;
 
             threadContexts[i] = {
-                threadIdentifiers[i],
-                &sourceImage,
-                &processedImage,
+                sourceImage,
+                processedImage,
+                rowFilter,
+                separableKernel,
+                stripWidth,
                 segmentStart,
                 segmentEnd,
-                &logFiles[i],
-                &synchronizationLock,
-                &globalStartTime,
-                10
+                trace ? &trace->buffers[i] : nullptr,
+                TRACE_SAMPLING_RATE,
+                counters,
+                i
             };
 
-            workerThreads[i] = CreateThread(nullptr, 0, ProcessImageSegment, &threadContexts[i], 0, nullptr);
-
-            if (!workerThreads[i]) {
-                throw std::runtime_error("Failed to create worker thread " + std::to_string(i));
-            }
+            // Started suspended so the priority and the pin apply from the first row
+            ThreadContext* context = &threadContexts[i];
+            Thread& worker = workerThreads.emplace_back([context]() { ProcessImageSegment(context); }, true);
 
-            int priorityLevel = THREAD_PRIORITY_NORMAL;
+            ThreadPriority priority = ThreadPriority::Normal;
             if (threadConfigurations[i] > 0) {
-                priorityLevel = THREAD_PRIORITY_HIGHEST;
+                priority = ThreadPriority::Highest;
             }
             else if (threadConfigurations[i] < 0) {
-                priorityLevel = THREAD_PRIORITY_LOWEST;
+                priority = ThreadPriority::Lowest;
             }
 
-            if (!SetThreadPriority(workerThreads[i], priorityLevel)) {
+            // Blurs are repeated for timing, so a refused priority is reported once
+            static bool priorityWarningShown = false;
+            if (!worker.SetPriority(priority) && !priorityWarningShown) {
                 std::cerr << "Warning: Could not set priority for thread " << i << std::endl;
+                priorityWarningShown = true;
             }
+            if (!options.threadCpus.empty() && !worker.PinToCore(options.threadCpus[i % options.threadCpus.size()])) {
+                std::cerr << "Warning: Could not pin thread " << i << std::endl;
+            }
+            worker.Resume();
         }
 
-        WaitForMultipleObjects(static_cast<DWORD>(workerThreads.size()), workerThreads.data(), TRUE, INFINITE);
+        for (Thread& worker : workerThreads) {
+            worker.Join();
+        }
+    }
 
-        for (auto thread : workerThreads) {
-            if (thread) CloseHandle(thread);
+    // Buffers for one blur of an image like source with these options, one
+    // per thread configuration, each sized for its whole band so the ring
+    // never wraps.
+    static BlurTrace CreateTrace(const ImageView& sourceImage, size_t threadsCount,
+        const BlurOptions& options = BlurOptions()) {
+        const SeparableGaussian::Kernel* separableKernel =
+            options.sigma > 0.0 ? &SeparableGaussian::GetKernel(options.sigma) : nullptr;
+        const int stripWidth = SelectStripWidth(sourceImage, separableKernel, options);
+        const int linesPerSegment = sourceImage.height / static_cast<int>(threadsCount);
+        const int stripsCount = (sourceImage.width + stripWidth - 1) / stripWidth;
+
+        BlurTrace trace;
+        trace.buffers.reserve(threadsCount);
+        for (size_t i = 0; i < threadsCount; ++i) {
+            const int segmentStart = static_cast<int>(i) * linesPerSegment;
+            const int segmentEnd = (i == threadsCount - 1) ? sourceImage.height : segmentStart + linesPerSegment;
+            const size_t recordsCount = static_cast<size_t>(segmentEnd - segmentStart) * stripsCount / TRACE_SAMPLING_RATE;
+            trace.buffers.emplace_back(static_cast<int32_t>(i) + 1, recordsCount + 1);
         }
+        return trace;
+    }
 
-        CloseHandle(synchronizationLock);
+    // One file per thread in the tab-separated format, plus the whole run
+    // as a Chrome trace.
+    static void WriteTraces(const BlurTrace& traces) {
+        for (const TraceBuffer& trace : traces.buffers) {
+            std::ofstream log("performance_" + std::to_string(trace.getThreadId()) + ".txt");
+            ExportTraceTsv(trace, traces.startNs, log);
 
-        std::cout << "Image processing completed with " << threadConfigurations.size() << " threads\n";
-        return processedImage;
+            if (trace.getDroppedCount() > 0) {
+                std::cerr << "Warning: thread " << trace.getThreadId() << " dropped "
+                    << trace.getDroppedCount() << " trace records\n";
+            }
+        }
+
+        std::ofstream chromeTrace("performance_trace.json");
+        ExportChromeTrace(traces.buffers, traces.startNs, chromeTrace);
+    }
+
+    // The kernel and strip width ApplyParallelBlur picks for these options.
+    static std::string DescribeBlur(const ImageView& sourceImage, const BlurOptions& options = BlurOptions()) {
+        const GaussianKernels::RowFilter rowFilter = GaussianKernels::SelectRowFilter(options.isa);
+        const SeparableGaussian::Kernel* separableKernel =
+            options.sigma > 0.0 ? &SeparableGaussian::GetKernel(options.sigma) : nullptr;
+        const int stripWidth = SelectStripWidth(sourceImage, separableKernel, options);
+
+        std::ostringstream description;
+        if (separableKernel) {
+            description << "separable kernel, sigma " << separableKernel->sigma << ", radius " << separableKernel->radius;
+        }
+        else {
+            description << GaussianKernels::IsaName(rowFilter) << " kernel";
+        }
+        if (stripWidth >= sourceImage.width) {
+            description << ", whole rows";
+        }
+        else {
+            description << ", " << stripWidth << "-column strips";
+        }
+        return description.str();
     }
 };
\ No newline at end of file
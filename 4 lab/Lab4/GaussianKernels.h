@@ -0,0 +1,168 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "../../common/CpuFeatures.h"
+
+// Row kernels for the 3x3 (1-2-1) Gaussian. A call filters the interior
+// columns [1, width - 1) of one output row from the three source rows around
+// it, working on the interleaved bytes directly: the same channel of the
+// left and right neighbours sits bytesPerPixel bytes away. Sums stay in
+// 16-bit integers (at most 16 * 255) and the division by the kernel weight
+// is a shift, which gives the same bytes as the floating point filter.
+// Alpha (the fourth byte of a 32-bit pixel) is copied, not filtered. The
+// first/last column and the first/last row are left to the caller.
+namespace GaussianKernels {
+
+enum class Isa {
+    Auto,
+    Reference,
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+using RowFilter = void (*)(const uint8_t* above, const uint8_t* center, const uint8_t* below,
+    uint8_t* output, int width, int bytesPerPixel);
+
+inline void FilterRowScalar(const uint8_t* above, const uint8_t* center, const uint8_t* below,
+    uint8_t* output, int width, int bytesPerPixel) {
+    const int end = (width - 1) * bytesPerPixel;
+    for (int i = bytesPerPixel; i < end; ++i) {
+        if (bytesPerPixel == 4 && (i & 3) == 3) {
+            output[i] = center[i];
+            continue;
+        }
+
+        const int left = above[i - bytesPerPixel] + 2 * center[i - bytesPerPixel] + below[i - bytesPerPixel];
+        const int middle = above[i] + 2 * center[i] + below[i];
+        const int right = above[i + bytesPerPixel] + 2 * center[i + bytesPerPixel] + below[i + bytesPerPixel];
+        output[i] = static_cast<uint8_t>((left + 2 * middle + right) >> 4);
+    }
+}
+
+#if CPU_FEATURES_X86
+
+inline __m128i VerticalSum16(const uint8_t* above, const uint8_t* center, const uint8_t* below,
+    __m128i zero, bool high) {
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above));
+    const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below));
+    const __m128i a16 = high ? _mm_unpackhi_epi8(a, zero) : _mm_unpacklo_epi8(a, zero);
+    const __m128i c16 = high ? _mm_unpackhi_epi8(c, zero) : _mm_unpacklo_epi8(c, zero);
+    const __m128i b16 = high ? _mm_unpackhi_epi8(b, zero) : _mm_unpacklo_epi8(b, zero);
+    return _mm_add_epi16(_mm_add_epi16(a16, b16), _mm_slli_epi16(c16, 1));
+}
+
+inline __m128i FilterHalfSse2(const uint8_t* above, const uint8_t* center, const uint8_t* below,
+    int i, int bytesPerPixel, __m128i zero, bool high) {
+    const __m128i left = VerticalSum16(above + i - bytesPerPixel, center + i - bytesPerPixel,
+        below + i - bytesPerPixel, zero, high);
+    const __m128i middle = VerticalSum16(above + i, center + i, below + i, zero, high);
+    const __m128i right = VerticalSum16(above + i + bytesPerPixel, center + i + bytesPerPixel,
+        below + i + bytesPerPixel, zero, high);
+    const __m128i sum = _mm_add_epi16(_mm_add_epi16(left, right), _mm_slli_epi16(middle, 1));
+    return _mm_srli_epi16(sum, 4);
+}
+
+inline void FilterRowSse2(const uint8_t* above, const uint8_t* center, const uint8_t* below,
+    uint8_t* output, int width, int bytesPerPixel) {
+    const int end = (width - 1) * bytesPerPixel;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = bytesPerPixel == 4 ? _mm_set1_epi32(static_cast<int>(0xFF000000)) : zero;
+
+    // Starting at bytesPerPixel keeps every 16-byte block pixel-aligned for 32-bit images
+    int i = bytesPerPixel;
+    for (; i + 16 <= end; i += 16) {
+        const __m128i low = FilterHalfSse2(above, center, below, i, bytesPerPixel, zero, false);
+        const __m128i high = FilterHalfSse2(above, center, below, i, bytesPerPixel, zero, true);
+        __m128i result = _mm_packus_epi16(low, high);
+
+        const __m128i original = _mm_loadu_si128(reinterpret_cast<const __m128i*>(center + i));
+        result = _mm_or_si128(_mm_andnot_si128(alphaMask, result), _mm_and_si128(alphaMask, original));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + i), result);
+    }
+
+    const int tailStartPixel = i / bytesPerPixel;
+    FilterRowScalar(above + (tailStartPixel - 1) * bytesPerPixel, center + (tailStartPixel - 1) * bytesPerPixel,
+        below + (tailStartPixel - 1) * bytesPerPixel, output + (tailStartPixel - 1) * bytesPerPixel,
+        width - tailStartPixel + 1, bytesPerPixel);
+}
+
+TARGET_AVX2 inline __m256i VerticalSum16Avx2(const uint8_t* above, const uint8_t* center,
+    const uint8_t* below, __m256i zero, bool high) {
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(above));
+    const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(center));
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(below));
+    const __m256i a16 = high ? _mm256_unpackhi_epi8(a, zero) : _mm256_unpacklo_epi8(a, zero);
+    const __m256i c16 = high ? _mm256_unpackhi_epi8(c, zero) : _mm256_unpacklo_epi8(c, zero);
+    const __m256i b16 = high ? _mm256_unpackhi_epi8(b, zero) : _mm256_unpacklo_epi8(b, zero);
+    return _mm256_add_epi16(_mm256_add_epi16(a16, b16), _mm256_slli_epi16(c16, 1));
+}
+
+// Unpack and pack both work within 128-bit lanes, so the bytes come back in order.
+TARGET_AVX2 inline __m256i FilterHalfAvx2(const uint8_t* above, const uint8_t* center,
+    const uint8_t* below, int i, int bytesPerPixel, __m256i zero, bool high) {
+    const __m256i left = VerticalSum16Avx2(above + i - bytesPerPixel, center + i - bytesPerPixel,
+        below + i - bytesPerPixel, zero, high);
+    const __m256i middle = VerticalSum16Avx2(above + i, center + i, below + i, zero, high);
+    const __m256i right = VerticalSum16Avx2(above + i + bytesPerPixel, center + i + bytesPerPixel,
+        below + i + bytesPerPixel, zero, high);
+    const __m256i sum = _mm256_add_epi16(_mm256_add_epi16(left, right), _mm256_slli_epi16(middle, 1));
+    return _mm256_srli_epi16(sum, 4);
+}
+
+TARGET_AVX2 inline void FilterRowAvx2(const uint8_t* above, const uint8_t* center, const uint8_t* below,
+    uint8_t* output, int width, int bytesPerPixel) {
+    const int end = (width - 1) * bytesPerPixel;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alphaMask = bytesPerPixel == 4 ? _mm256_set1_epi32(static_cast<int>(0xFF000000)) : zero;
+
+    int i = bytesPerPixel;
+    for (; i + 32 <= end; i += 32) {
+        const __m256i low = FilterHalfAvx2(above, center, below, i, bytesPerPixel, zero, false);
+        const __m256i high = FilterHalfAvx2(above, center, below, i, bytesPerPixel, zero, true);
+        const __m256i result = _mm256_packus_epi16(low, high);
+
+        const __m256i original = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(center + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), _mm256_blendv_epi8(result, original, alphaMask));
+    }
+
+    const int tailStartPixel = i / bytesPerPixel;
+    FilterRowSse2(above + (tailStartPixel - 1) * bytesPerPixel, center + (tailStartPixel - 1) * bytesPerPixel,
+        below + (tailStartPixel - 1) * bytesPerPixel, output + (tailStartPixel - 1) * bytesPerPixel,
+        width - tailStartPixel + 1, bytesPerPixel);
+}
+
+#endif
+
+// Returns nullptr for Isa::Reference, which is the per-pixel floating point filter.
+inline RowFilter SelectRowFilter(Isa isa) {
+#if CPU_FEATURES_X86
+    const CpuFeatures& features = CpuFeatures::Get();
+    if (isa == Isa::Auto) {
+        isa = features.avx2 ? Isa::Avx2 : features.sse2 ? Isa::Sse2 : Isa::Scalar;
+    }
+
+    if (isa == Isa::Avx2 && features.avx2) {
+        return FilterRowAvx2;
+    }
+    if (isa == Isa::Sse2 && features.sse2) {
+        return FilterRowSse2;
+    }
+#else
+    if (isa == Isa::Auto) {
+        isa = Isa::Scalar;
+    }
+#endif
+    return isa == Isa::Reference ? nullptr : FilterRowScalar;
+}
+
+inline std::string IsaName(RowFilter filter) {
+#if CPU_FEATURES_X86
+    if (filter == FilterRowAvx2) return "avx2";
+    if (filter == FilterRowSse2) return "sse2";
+#endif
+    return filter ? "scalar" : "reference";
+}
+
+}
@@ -1,61 +1,176 @@
-#include <format>
 #include <iostream>
 #include <string>
 #include <vector>
-#include <ctime>
 #include <stdexcept>
 #include "BMPUtils.h"
+#include "../../common/Benchmark.h"
+#include "../../common/Topology.h"
 
 struct ProgramArgs {
     std::string inputFilePath;
     std::string outputFilePath;
     unsigned coreCount;
     std::vector<int> threadPriorities;
+    bool useMappedFiles;
+    bool countEvents;
+    // Unset keeps the workers unpinned, as before placements existed
+    bool usePlacement;
+    Placement placement;
+    bool showTopology;
+    BlurOptions blurOptions;
+    BenchmarkOptions benchmarkOptions;
 };
 
+GaussianKernels::Isa ParseIsa(const std::string& name) {
+    if (name == "auto") return GaussianKernels::Isa::Auto;
+    if (name == "reference") return GaussianKernels::Isa::Reference;
+    if (name == "scalar") return GaussianKernels::Isa::Scalar;
+    if (name == "sse2") return GaussianKernels::Isa::Sse2;
+    if (name == "avx2") return GaussianKernels::Isa::Avx2;
+    throw std::invalid_argument("Unknown kernel: " + name);
+}
+
 ProgramArgs ParseArguments(const int argc, char** argv) {
     if (argc <= 4) {
         throw std::invalid_argument(
-            std::format(
-                "Usage: {} <input-file-path> <output-file-path> <core-count> <first-thread-priority> <second-thread-priority> <third-thread-priority>",
-                argv[0])
+            std::string("Usage: ") + argv[0] +
+            " <input-file-path> <output-file-path> <core-count> <first-thread-priority> <second-thread-priority> <third-thread-priority> [--mmap] [--perf] [--kernel=auto|reference|scalar|sse2|avx2] [--sigma=<value>] [--strip=<columns>] [--placement=linear|compact|scatter|physical|numa[:node]] [--topology] " +
+            BenchmarkOptions::getUsage()
         );
     }
 
     std::vector<int> priorities{};
+    bool useMappedFiles = false;
+    bool countEvents = false;
+    bool usePlacement = false;
+    Placement placement{};
+    bool showTopology = false;
+    BlurOptions blurOptions{};
+    BenchmarkOptions benchmarkOptions{};
     for (int i = 4; i < argc; ++i) {
-        priorities.push_back(std::stoi(argv[i]));
+        const std::string arg = argv[i];
+        if (arg == "--mmap") {
+            useMappedFiles = true;
+            continue;
+        }
+        if (arg == "--perf") {
+            countEvents = true;
+            continue;
+        }
+        if (arg.rfind("--placement=", 0) == 0) {
+            placement = Placement::Parse(arg.substr(std::string("--placement=").size()));
+            usePlacement = true;
+            continue;
+        }
+        if (arg == "--topology") {
+            showTopology = true;
+            continue;
+        }
+        if (arg.rfind("--kernel=", 0) == 0) {
+            blurOptions.isa = ParseIsa(arg.substr(std::string("--kernel=").size()));
+            continue;
+        }
+        if (arg.rfind("--sigma=", 0) == 0) {
+            blurOptions.sigma = std::stod(arg.substr(std::string("--sigma=").size()));
+            if (!(blurOptions.sigma > 0.0)) {
+                throw std::invalid_argument("Sigma must be positive");
+            }
+            continue;
+        }
+        if (arg.rfind("--strip=", 0) == 0) {
+            blurOptions.stripWidth = std::stoi(arg.substr(std::string("--strip=").size()));
+            if (blurOptions.stripWidth <= 0) {
+                throw std::invalid_argument("Strip width must be positive");
+            }
+            continue;
+        }
+        if (benchmarkOptions.ParseFlag(arg)) {
+            continue;
+        }
+        priorities.push_back(std::stoi(arg));
+    }
+
+    if (priorities.empty()) {
+        throw std::invalid_argument("At least one thread priority is required");
     }
 
     return {
         argv[1],
         argv[2],
         static_cast<unsigned>(std::stoi(argv[3])),
-        priorities
+        priorities,
+        useMappedFiles,
+        countEvents,
+        usePlacement,
+        placement,
+        showTopology,
+        blurOptions,
+        benchmarkOptions
     };
 }
 
+// Every blur pass reads the source and overwrites the result, so the
+// harness can repeat it and the output still holds a single blur. The
+// reported time is the median wall-clock time of one pass. The progress
+// traces (performance_*.txt and performance_trace.json), and the hardware
+// counters with --perf, come from one more pass, so the timed ones stay
+// uninstrumented.
 int main(const int argc, char** argv) {
     try {
-        const std::clock_t programStart = std::clock();
-        constexpr int EXECUTION_COUNT = 1;
-
-        const auto [inputFile, outputFile, cores, threadConfigs] = ParseArguments(argc, argv);
-        auto sourceImage = ImageProcessor::LoadImage(inputFile);
+        auto [inputFile, outputFile, cores, threadConfigs, useMappedFiles, countEvents, usePlacement, placement,
+            showTopology, blurOptions, benchmarkOptions] = ParseArguments(argc, argv);
 
-        BMPImage processedImage;
-        for (int iteration = 0; iteration < EXECUTION_COUNT; ++iteration) {
-            processedImage = ImageProcessor::ApplyParallelBlur(sourceImage, threadConfigs);
+        // core-count keeps the first N CPUs of the placement order
+        const CpuTopology topology = CpuTopology::Detect();
+        if (usePlacement) {
+            blurOptions.threadCpus = PlanPlacement(topology, placement, static_cast<int>(threadConfigs.size()), cores);
         }
+        if (showTopology) {
+            std::cout << "Topology: " << topology.Describe() << "\n";
+            if (usePlacement) {
+                std::cout << "Placement " << placement.getName() << ": CPUs " << FormatCpuList(blurOptions.threadCpus) << "\n";
+            }
+        }
+
+        Benchmark harness(benchmarkOptions);
+        auto blur = [&](const ImageView& source, const ImageView& result) {
+            std::cout << "Image processing with " << threadConfigs.size() << " threads ("
+                << ImageProcessor::DescribeBlur(source, blurOptions) << ")\n";
+            BenchmarkResult timing = harness.Run("blur", [&]() {
+                ImageProcessor::ApplyParallelBlur(source, result, threadConfigs, blurOptions);
+            });
 
-        ImageProcessor::SaveImage(outputFile, processedImage);
+            BlurTrace trace = ImageProcessor::CreateTrace(source, threadConfigs.size(), blurOptions);
+            PerfReport counters(threadConfigs.size());
+            ImageProcessor::ApplyParallelBlur(source, result, threadConfigs, blurOptions,
+                countEvents ? &counters : nullptr, &trace);
+            ImageProcessor::WriteTraces(trace);
+            if (countEvents) {
+                counters.Print(std::cout, "Counters for one pass");
+            }
+            return timing;
+        };
 
-        const auto executionTime = static_cast<double>(std::clock() - programStart) / CLOCKS_PER_SEC * 1000.0;
-        std::cout << cores << '\t' << threadConfigs.size() << '\t' << executionTime << std::endl;
+        BenchmarkResult timing;
+        if (useMappedFiles) {
+            const auto sourceImage = MappedBitmap::Open(inputFile);
+            const auto processedImage = MappedBitmap::CreateLike(outputFile, sourceImage);
+            timing = blur(sourceImage.view(), processedImage.view());
+        }
+        else {
+            const auto sourceImage = ImageProcessor::LoadImage(inputFile);
+            auto processedImage = BMPImage::CreateLike(sourceImage);
+            timing = blur(sourceImage.view(), processedImage.view());
+            ImageProcessor::SaveImage(outputFile, processedImage);
+        }
+
+        std::cout << "Blur: " << Benchmark::FormatSummary(timing) << std::endl;
+        std::cout << cores << '\t' << threadConfigs.size() << '\t' << timing.median * 1000.0 << std::endl;
+        harness.WriteReports();
     }
     catch (const std::exception& error) {
         std::cerr << "Application error: " << error.what() << std::endl;
         return 1;
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,188 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include "../../common/ImageView.h"
+
+// Separable Gaussian of arbitrary sigma. A 2D kernel of radius r costs
+// (2r + 1)^2 samples per pixel; splitting it into a horizontal and a vertical
+// pass brings that down to 2 * (2r + 1).
+namespace SeparableGaussian {
+
+// One half of a symmetric kernel: weights[0] is the centre tap and
+// weights[k] applies at offsets -k and +k. Normalised to sum to 1.
+struct Kernel {
+    double sigma;
+    int radius;
+    std::vector<float> weights;
+};
+
+inline Kernel MakeKernel(double sigma) {
+    if (!(sigma > 0.0)) {
+        throw std::invalid_argument("Gaussian sigma must be positive");
+    }
+
+    Kernel kernel{ sigma, std::max(1, static_cast<int>(std::ceil(3.0 * sigma))), {} };
+    kernel.weights.resize(kernel.radius + 1);
+
+    double total = 0.0;
+    for (int k = 0; k <= kernel.radius; ++k) {
+        const double weight = std::exp(-(k * k) / (2.0 * sigma * sigma));
+        kernel.weights[k] = static_cast<float>(weight);
+        total += k == 0 ? weight : 2.0 * weight;
+    }
+    for (float& weight : kernel.weights) {
+        weight = static_cast<float>(weight / total);
+    }
+
+    return kernel;
+}
+
+// Kernels are built once per sigma and kept for the lifetime of the process,
+// so repeated blurs with the same sigma only pay for a lookup. Returned
+// references stay valid: entries are never removed.
+inline const Kernel& GetKernel(double sigma) {
+    static std::mutex lock;
+    static std::map<double, std::unique_ptr<Kernel>> kernels;
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto& entry = kernels[sigma];
+    if (!entry) {
+        entry = std::make_unique<Kernel>(MakeKernel(sigma));
+    }
+    return *entry;
+}
+
+// Bytes of working set per strip column: the ring plus the accumulator row.
+inline size_t StripBytesPerColumn(const Kernel& kernel) {
+    return static_cast<size_t>(2 * kernel.radius + 2) * 3 * sizeof(float);
+}
+
+// Produces output rows one at a time, in increasing order, for the columns
+// [firstColumn, lastColumn) of a strip. Every source row is filtered
+// horizontally exactly once into a ring of 2r + 1 float rows (reading r
+// halo columns on each side of the strip); the vertical pass then combines
+// the ring rows around the output row, so both source and destination are
+// walked in row order. Only the three colour channels are filtered; alpha
+// is copied. The kernel is clipped at the image borders and the remaining
+// weights renormalised, like the 3x3 filter.
+class RowFilter {
+public:
+    RowFilter(const ImageView& source, const Kernel& kernel, int firstColumn, int lastColumn)
+        : source(source),
+        kernel(kernel),
+        firstColumn(firstColumn),
+        columnsCount(lastColumn - firstColumn),
+        rowLength(columnsCount * COLOR_CHANNELS),
+        ringSize(2 * kernel.radius + 1),
+        ring(static_cast<size_t>(ringSize) * rowLength),
+        accumulator(rowLength),
+        horizontalNorms(columnsCount) {
+        for (int i = 0; i < columnsCount; ++i) {
+            horizontalNorms[i] = 1.0f / WeightInside(firstColumn + i, source.width);
+        }
+    }
+
+    RowFilter(const RowFilter&) = delete;
+    RowFilter& operator=(const RowFilter&) = delete;
+
+    void ProcessRow(int y, uint8_t* output) {
+        const int radius = kernel.radius;
+        const int firstRow = std::max(0, y - radius);
+        const int lastRow = std::min(source.height - 1, y + radius);
+
+        if (nextSourceRow < firstRow) {
+            nextSourceRow = firstRow;
+        }
+        for (; nextSourceRow <= lastRow; ++nextSourceRow) {
+            FilterHorizontal(nextSourceRow);
+        }
+
+        std::fill(accumulator.begin(), accumulator.end(), 0.0f);
+        for (int sourceRow = firstRow; sourceRow <= lastRow; ++sourceRow) {
+            const float weight = kernel.weights[std::abs(sourceRow - y)];
+            const float* filtered = RingRow(sourceRow);
+            for (int i = 0; i < rowLength; ++i) {
+                accumulator[i] += weight * filtered[i];
+            }
+        }
+
+        const float norm = 1.0f / WeightInside(y, source.height);
+        const int bytesPerPixel = source.bytesPerPixel;
+        const uint8_t* original = source.row(y);
+        for (int x = firstColumn; x < firstColumn + columnsCount; ++x) {
+            for (int channel = 0; channel < COLOR_CHANNELS; ++channel) {
+                const float value = accumulator[(x - firstColumn) * COLOR_CHANNELS + channel] * norm + 0.5f;
+                output[x * bytesPerPixel + channel] = static_cast<uint8_t>(std::min(value, 255.0f));
+            }
+
+            // Alpha is not filtered, only carried over
+            for (int channel = COLOR_CHANNELS; channel < bytesPerPixel; ++channel) {
+                output[x * bytesPerPixel + channel] = original[x * bytesPerPixel + channel];
+            }
+        }
+    }
+
+private:
+    static constexpr int COLOR_CHANNELS = 3;
+
+    float* RingRow(int sourceRow) {
+        return ring.data() + static_cast<size_t>(sourceRow % ringSize) * rowLength;
+    }
+
+    // Sum of the kernel taps that land inside [0, size) when centred on position.
+    float WeightInside(int position, int size) const {
+        float total = 0.0f;
+        for (int k = -kernel.radius; k <= kernel.radius; ++k) {
+            if (position + k >= 0 && position + k < size) {
+                total += kernel.weights[std::abs(k)];
+            }
+        }
+        return total;
+    }
+
+    void FilterHorizontal(int sourceRow) {
+        const int radius = kernel.radius;
+        const int width = source.width;
+        const int bytesPerPixel = source.bytesPerPixel;
+        const uint8_t* input = source.row(sourceRow);
+        float* filtered = RingRow(sourceRow);
+
+        for (int i = 0; i < columnsCount; ++i) {
+            const int x = firstColumn + i;
+            const int first = std::max(0, x - radius);
+            const int last = std::min(width - 1, x + radius);
+
+            float sums[COLOR_CHANNELS] = {};
+            for (int sampleX = first; sampleX <= last; ++sampleX) {
+                const float weight = kernel.weights[std::abs(sampleX - x)];
+                const uint8_t* pixel = input + sampleX * bytesPerPixel;
+                for (int channel = 0; channel < COLOR_CHANNELS; ++channel) {
+                    sums[channel] += weight * pixel[channel];
+                }
+            }
+
+            for (int channel = 0; channel < COLOR_CHANNELS; ++channel) {
+                filtered[i * COLOR_CHANNELS + channel] = sums[channel] * horizontalNorms[i];
+            }
+        }
+    }
+
+    ImageView source;
+    const Kernel& kernel;
+    int firstColumn;
+    int columnsCount;
+    int rowLength;
+    int ringSize;
+    std::vector<float> ring;
+    std::vector<float> accumulator;
+    std::vector<float> horizontalNorms;
+    int nextSourceRow = 0;
+};
+
+}
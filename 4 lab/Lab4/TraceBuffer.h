@@ -0,0 +1,107 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+// Fixed-size binary trace record. Timestamps come from the monotonic clock
+// and are stored as raw nanoseconds; exporters make them relative.
+struct TraceRecord {
+    int32_t threadId;
+    int32_t row;
+    int32_t cpu;
+    int64_t timestampNs;
+};
+
+inline int64_t MonotonicNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline int32_t CurrentCpu() {
+#ifdef _WIN32
+    return static_cast<int32_t>(GetCurrentProcessorNumber());
+#else
+    return sched_getcpu();
+#endif
+}
+
+// Single-writer ring of trace records. The storage is allocated up front
+// and only the owning thread writes, so recording takes no lock, makes no
+// allocation and does no I/O. Once full, the oldest records are overwritten.
+// Read only after the writer has been joined.
+class alignas(64) TraceBuffer {
+public:
+    TraceBuffer(int32_t threadId, size_t capacity)
+        : threadId(threadId), records(std::max<size_t>(capacity, 1)) {
+    }
+
+    void Record(int32_t row) {
+        records[written % records.size()] = { threadId, row, CurrentCpu(), MonotonicNanoseconds() };
+        written++;
+    }
+
+    int32_t getThreadId() const {
+        return threadId;
+    }
+
+    uint64_t getDroppedCount() const {
+        return written > records.size() ? written - records.size() : 0;
+    }
+
+    // Oldest first.
+    std::vector<TraceRecord> getRecords() const {
+        std::vector<TraceRecord> ordered;
+        const uint64_t first = getDroppedCount();
+        for (uint64_t i = first; i < written; ++i) {
+            ordered.push_back(records[i % records.size()]);
+        }
+        return ordered;
+    }
+
+private:
+    int32_t threadId;
+    std::vector<TraceRecord> records;
+    uint64_t written = 0;
+};
+
+// "threadId<TAB>elapsedMs" per record, the format of the performance_*.txt logs.
+inline void ExportTraceTsv(const TraceBuffer& trace, int64_t startNs, std::ostream& output) {
+    for (const TraceRecord& record : trace.getRecords()) {
+        output << record.threadId << "\t" << (record.timestampNs - startNs) / 1000000 << "\n";
+    }
+}
+
+// Chrome trace event JSON (chrome://tracing, Perfetto). The time between
+// consecutive records of a thread becomes one complete event ending at the
+// recorded row, so a thread that was descheduled shows up as an unusually
+// long slice and a migration as a change of the cpu argument.
+inline void ExportChromeTrace(const std::vector<TraceBuffer>& traces, int64_t startNs, std::ostream& output) {
+    output << "{\"traceEvents\":[";
+    bool first = true;
+    for (const TraceBuffer& trace : traces) {
+        int64_t sliceStartNs = startNs;
+        for (const TraceRecord& record : trace.getRecords()) {
+            output << (first ? "\n" : ",\n");
+            first = false;
+
+            output << "{\"name\":\"rows\",\"ph\":\"X\",\"pid\":1,\"tid\":" << record.threadId
+                << ",\"ts\":" << (sliceStartNs - startNs) / 1000.0
+                << ",\"dur\":" << (record.timestampNs - sliceStartNs) / 1000.0
+                << ",\"args\":{\"row\":" << record.row << ",\"cpu\":" << record.cpu << "}}";
+
+            sliceStartNs = record.timestampNs;
+        }
+    }
+    output << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
@@ -1,95 +1,683 @@
-#include <windows.h>
 #include <string>
 #include <iostream>
-#include "tchar.h"
-#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "Ledger.h"
+#include "WriteAheadLog.h"
+#include "SharedLedger.h"
+#include "LockBenchmark.h"
+#include "ShardedLedger.h"
+#include "../../common/Benchmark.h"
+#include "../../common/Threading.h"
+#include "../../common/Topology.h"
 
-CRITICAL_SECTION FileLockingCriticalSection;
+#ifndef _WIN32
+#include <csignal>
+#include <sys/wait.h>
+#endif
 
-int ReadFromFile() {
-    std::fstream myfile("balance.txt", std::ios_base::in);
-    int result;
-    myfile >> result;
-    myfile.close();
-    return result;
+// balance.txt is no longer read or rewritten by every operation: the
+// balances live in a Ledger, every change is appended to balance.wal and
+// the text file is a snapshot of the ledger.
+const char* const SNAPSHOT_PATH = "balance.txt";
+const char* const LOG_PATH = "balance.wal";
+
+void Deposit(Ledger& ledger, WriteAheadLog& log, int money) {
+    int64_t balance = 0;
+    log.Deposit(ledger, 0, money, &balance);
+    printf("Balance after deposit: %lld\n", static_cast<long long>(balance));
 }
 
-void WriteToFile(int data) {
-    std::fstream myfile("balance.txt", std::ios_base::out);
-    myfile << data << std::endl;
-    myfile.close();
+void Withdraw(Ledger& ledger, WriteAheadLog& log, int money) {
+    int64_t balance = 0;
+    if (!log.Withdraw(ledger, 0, money, &balance)) {
+        printf("Cannot withdraw money, balance lower than %d\n", money);
+    }
+    else {
+        printf("Balance after withdraw: %lld\n", static_cast<long long>(balance));
+    }
 }
 
-int GetBalance() {
-    EnterCriticalSection(&FileLockingCriticalSection);
-    int balance = ReadFromFile();
-    LeaveCriticalSection(&FileLockingCriticalSection);
-    return balance;
+// The original scenario: 50 threads on one core, the even ones depositing
+// 230 and the odd ones withdrawing 1000 from a single account. The balance
+// starts from whatever the log recorded in earlier runs.
+int RunScenario() {
+    Ledger ledger(1);
+    RecoveryResult recovery;
+    try {
+        recovery = WriteAheadLog::Recover(LOG_PATH, ledger);
+    }
+    catch (const std::exception& error) {
+        printf("%s\n", error.what());
+        return 1;
+    }
+    printf("Recovered %llu operations from %s, balance %lld\n", static_cast<unsigned long long>(recovery.recordsCount),
+        LOG_PATH, static_cast<long long>(ledger.GetBalance(0)));
+
+    WriteAheadLog log(LOG_PATH, SyncPolicy::Batch, 64, recovery.lastSequence);
+    SnapshotWriter snapshots(ledger, SNAPSHOT_PATH, std::chrono::milliseconds(100));
+
+    std::vector<Thread> threads;
+    threads.reserve(50);
+
+    SetProcessAffinity(1);
+    for (int i = 0; i < 50; i++) {
+        threads.emplace_back((i % 2 == 0)
+            ? std::function<void()>([&ledger, &log]() { Deposit(ledger, log, 230); })
+            : std::function<void()>([&ledger, &log]() { Withdraw(ledger, log, 1000); }));
+    }
+
+    for (Thread& thread : threads) {
+        thread.Join();
+    }
+
+    snapshots.RequestSnapshot();
+    printf("Final Balance: %lld\n", static_cast<long long>(ledger.GetBalance(0)));
+
+    std::cout << "Press Enter to exit..." << std::endl;
+    std::cin.get();
+
+    return 0;
 }
 
-void Deposit(int money) {
-    EnterCriticalSection(&FileLockingCriticalSection);
+struct LedgerBenchOptions {
+    size_t accountsCount = 1 << 16;
+    // Zero picks the mode's default: a thread per CPU for the ledger, 64 for
+    // the log, since a batch can only hold operations of waiting threads
+    int threadsCount = 0;
+    int operationsCount = 0;
+    std::vector<size_t> batchSizes = { 1, 8, 64, 512 };
+    std::string logPath = "bench.wal";
+    // Kept apart from SNAPSHOT_PATH, which the scenario's balance lives in
+    std::string snapshotPath = "bench_balance.txt";
+    int processesCount = 2;
+    bool killHolder = false;
+    // Lock benchmark grid; no core counts means 1, 2, 4, ... up to every CPU
+    std::vector<std::string> lockNames;
+    std::vector<size_t> coreCounts;
+    std::vector<size_t> readPercents = { 0, 50, 90 };
+    size_t shardsCount = 256;
+    BenchmarkOptions benchmark;
+};
 
-    int balance = ReadFromFile();
-    balance += money;
-    WriteToFile(balance);
-    printf("Balance after deposit: %d\n", balance);
+// splitmix64: cheap, and every worker gets its own independent stream
+uint64_t NextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
 
-    LeaveCriticalSection(&FileLockingCriticalSection);
+// Every worker runs operationsCount deposits and withdrawals of 1..100 on
+// random accounts. Afterwards the ledger must hold exactly the initial
+// money plus what was deposited minus what was withdrawn. The ledger is
+// snapshotted once, after timing, so file writes stay out of the passes.
+int RunLedgerBenchmark(const LedgerBenchOptions& options) {
+    constexpr int64_t INITIAL_BALANCE = 1000;
+    Ledger ledger(options.accountsCount, INITIAL_BALANCE);
+    std::atomic<int64_t> netDeposits{ 0 };
+    std::atomic<int64_t> rejectedCount{ 0 };
+    uint64_t pass = 0;
+
+    Benchmark harness(options.benchmark);
+    BenchmarkResult timing = harness.Run("ledger", [&]() {
+        std::vector<Thread> workers;
+        workers.reserve(options.threadsCount);
+        ++pass;
+        for (int i = 0; i < options.threadsCount; i++) {
+            workers.emplace_back([&, i]() {
+                uint64_t state = pass << 32 | static_cast<uint64_t>(i);
+                int64_t net = 0;
+                int64_t rejected = 0;
+                for (int operation = 0; operation < options.operationsCount; operation++) {
+                    const uint64_t random = NextRandom(state);
+                    const size_t account = static_cast<size_t>(random % options.accountsCount);
+                    const int64_t amount = 1 + static_cast<int64_t>((random >> 40) % 100);
+                    if (random >> 63) {
+                        ledger.Deposit(account, amount);
+                        net += amount;
+                    }
+                    else if (ledger.Withdraw(account, amount)) {
+                        net -= amount;
+                    }
+                    else {
+                        rejected++;
+                    }
+                }
+                netDeposits += net;
+                rejectedCount += rejected;
+            });
+        }
+        for (Thread& worker : workers) {
+            worker.Join();
+        }
+    });
+
+    const double operations = static_cast<double>(options.threadsCount) * options.operationsCount;
+    const int64_t expected = static_cast<int64_t>(options.accountsCount) * INITIAL_BALANCE + netDeposits.load();
+    const int64_t total = ledger.getTotal();
+    const bool saved = WriteLedgerSnapshot(ledger, options.snapshotPath);
+
+    std::cout << "Ledger: " << options.accountsCount << " accounts, " << options.threadsCount << " threads, "
+        << options.operationsCount << " operations per thread" << std::endl;
+    std::cout << "Pass: " << Benchmark::FormatSummary(timing) << std::endl;
+    std::cout << "Throughput: " << operations / timing.median / 1e6 << " Mops/s" << std::endl;
+    std::cout << "Rejected withdrawals: " << rejectedCount.load() << std::endl;
+    std::cout << "Total balance: " << total << " (expected " << expected << ")" << std::endl;
+    if (!saved) {
+        std::cerr << "Cannot write snapshot: " << options.snapshotPath << std::endl;
+    }
+    harness.WriteReports();
+
+    return total == expected ? 0 : 1;
 }
 
-void Withdraw(int money) {
-    EnterCriticalSection(&FileLockingCriticalSection);
+// Durable throughput for every sync policy and batch limit, each on a fresh
+// log. Accounts start rich enough that no withdrawal is refused, so every
+// operation is logged. Afterwards the log is replayed into an empty ledger,
+// which must come out equal to the live one. Throws if the log cannot be
+// opened or written.
+int RunLogBenchmark(const LedgerBenchOptions& options) {
+    constexpr int64_t INITIAL_BALANCE = int64_t(1) << 40;
+    const SyncPolicy policies[] = { SyncPolicy::None, SyncPolicy::Batch };
+    Benchmark harness(options.benchmark);
+    bool allRecovered = true;
 
-    int balance = ReadFromFile();
-    if (balance < money) {
-        printf("Cannot withdraw money, balance lower than %d\n", money);
+    std::cout << "Log: " << options.accountsCount << " accounts, " << options.threadsCount << " threads, "
+        << options.operationsCount << " operations per thread" << std::endl;
+    std::cout << "sync\tbatch\tops/s\trecords/batch\trecovered" << std::endl;
+
+    for (SyncPolicy policy : policies) {
+        const char* policyName = policy == SyncPolicy::None ? "none" : "fdatasync";
+        for (size_t batchSize : options.batchSizes) {
+            std::filesystem::remove(options.logPath);
+            Ledger ledger(options.accountsCount, INITIAL_BALANCE);
+            uint64_t pass = 0;
+            uint64_t batchesCount = 0;
+            uint64_t recordsCount = 0;
+            std::atomic<bool> writeFailed{ false };
+            BenchmarkResult timing;
+            {
+                WriteAheadLog log(options.logPath, policy, batchSize);
+                timing = harness.Run(std::string(policyName) + " batch " + std::to_string(batchSize), [&]() {
+                    std::vector<Thread> workers;
+                    workers.reserve(options.threadsCount);
+                    ++pass;
+                    for (int i = 0; i < options.threadsCount; i++) {
+                        workers.emplace_back([&, i]() {
+                            uint64_t state = pass << 32 | static_cast<uint64_t>(i);
+                            for (int operation = 0; operation < options.operationsCount; operation++) {
+                                const uint64_t random = NextRandom(state);
+                                const size_t account = static_cast<size_t>(random % options.accountsCount);
+                                const int64_t amount = 1 + static_cast<int64_t>((random >> 40) % 100);
+                                try {
+                                    if (random >> 63) {
+                                        log.Deposit(ledger, account, amount);
+                                    }
+                                    else {
+                                        log.Withdraw(ledger, account, amount);
+                                    }
+                                }
+                                catch (const std::exception&) {
+                                    // Every later operation would fail the same way
+                                    writeFailed = true;
+                                    return;
+                                }
+                            }
+                        });
+                    }
+                    for (Thread& worker : workers) {
+                        worker.Join();
+                    }
+                    if (writeFailed) {
+                        throw std::runtime_error("Cannot write log: " + options.logPath);
+                    }
+                });
+                batchesCount = log.getBatchesCount();
+                recordsCount = log.getRecordsCount();
+            }
+
+            Ledger recovered(options.accountsCount, INITIAL_BALANCE);
+            WriteAheadLog::Recover(options.logPath, recovered);
+            const bool matches = recovered.Snapshot() == ledger.Snapshot();
+            allRecovered = allRecovered && matches;
+
+            const double operations = static_cast<double>(options.threadsCount) * options.operationsCount;
+            std::cout << policyName << '\t' << batchSize << '\t' << operations / timing.median << '\t'
+                << static_cast<double>(recordsCount) / std::max<uint64_t>(1, batchesCount) << '\t'
+                << (matches ? "yes" : "NO") << std::endl;
+        }
     }
-    else {
-        Sleep(20);
-        balance -= money;
-        WriteToFile(balance);
-        printf("Balance after withdraw: %d\n", balance);
+
+    std::filesystem::remove(options.logPath);
+    harness.WriteReports();
+    return allRecovered ? 0 : 1;
+}
+
+#ifndef _WIN32
+// Runs operationsCount random deposits and withdrawals against the shared
+// ledger named name, from a fresh mapping as an unrelated process would.
+void RunSharedWorker(const std::string& name, int operationsCount, uint64_t seed) {
+    SharedLedger ledger = SharedLedger::Open(name);
+    const size_t accountsCount = ledger.getAccountsCount();
+    uint64_t state = seed;
+    for (int operation = 0; operation < operationsCount || operationsCount == 0; operation++) {
+        const uint64_t random = NextRandom(state);
+        const size_t account = static_cast<size_t>(random % accountsCount);
+        const int64_t amount = 1 + static_cast<int64_t>((random >> 40) % 100);
+        if (random >> 63) {
+            ledger.Deposit(account, amount);
+        }
+        else {
+            ledger.Withdraw(account, amount);
+        }
+    }
+}
+
+// processesCount worker processes share one ledger in POSIX shared memory.
+// With killHolder one more process works without end and is killed
+// partway, likely inside the lock, so the others must recover the mutex.
+// At the end no balance may be negative and the total must equal the
+// initial money plus deposits minus withdrawals.
+int RunSharedStress(const LedgerBenchOptions& options) {
+    constexpr int64_t INITIAL_BALANCE = 1000;
+    const std::string name = "/lab5-ledger-" + std::to_string(getpid());
+    SharedLedger ledger = SharedLedger::Create(name, options.accountsCount, INITIAL_BALANCE);
+
+    std::vector<pid_t> workers;
+    const auto start = std::chrono::steady_clock::now();
+    const int processesCount = options.processesCount + (options.killHolder ? 1 : 0);
+    for (int i = 0; i < processesCount; i++) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            int status = 0;
+            try {
+                const bool endless = i == options.processesCount;
+                RunSharedWorker(name, endless ? 0 : options.operationsCount, static_cast<uint64_t>(i + 1) << 32);
+            }
+            catch (const std::exception& error) {
+                fprintf(stderr, "Worker %d: %s\n", i, error.what());
+                status = 1;
+            }
+            _exit(status);
+        }
+        if (pid < 0) {
+            perror("fork");
+            break;
+        }
+        workers.push_back(pid);
     }
 
-    LeaveCriticalSection(&FileLockingCriticalSection);
+    if (options.killHolder && static_cast<int>(workers.size()) == processesCount) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        kill(workers.back(), SIGKILL);
+    }
+
+    bool workersSucceeded = static_cast<int>(workers.size()) == processesCount;
+    for (size_t i = 0; i < workers.size(); i++) {
+        int status = 0;
+        waitpid(workers[i], &status, 0);
+        const bool killed = options.killHolder && i + 1 == workers.size();
+        if (!killed && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+            workersSucceeded = false;
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const SharedLedger::Totals totals = ledger.getTotals();
+    SharedLedger::Unlink(name);
+
+    const uint64_t operations = totals.operationsCount + totals.rejectedCount;
+    const bool conserved = totals.balance == totals.initial + totals.deposited - totals.withdrawn;
+    const bool complete = options.killHolder
+        || operations == static_cast<uint64_t>(options.processesCount) * options.operationsCount;
+
+    std::cout << "Shared ledger: " << options.accountsCount << " accounts, " << options.processesCount << " processes, "
+        << options.operationsCount << " operations per process" << (options.killHolder ? ", one more killed" : "") << std::endl;
+    std::cout << "Throughput: " << operations / seconds << " ops/s (" << operations << " operations in "
+        << seconds << " s)" << std::endl;
+    std::cout << "Rejected withdrawals: " << totals.rejectedCount << std::endl;
+    std::cout << "Blocked in the kernel: " << totals.contendedCount << " of " << operations << " locks" << std::endl;
+    std::cout << "Recovered from a dead holder: " << totals.recoveriesCount << std::endl;
+    std::cout << "Total balance: " << totals.balance << " (expected " << totals.initial + totals.deposited - totals.withdrawn
+        << "), lowest " << totals.lowestBalance << std::endl;
+
+    return workersSucceeded && conserved && complete && totals.lowestBalance >= 0 ? 0 : 1;
 }
+#endif
 
-DWORD WINAPI DoDeposit(CONST LPVOID lpParameter) {
-    Deposit((int)(INT_PTR)lpParameter);
-    return 0;
+// --cores, or 1, 2, 4, ... and finally every CPU of the machine.
+std::vector<size_t> SelectCoreCounts(const LedgerBenchOptions& options, const CpuTopology& topology) {
+    if (!options.coreCounts.empty()) {
+        return options.coreCounts;
+    }
+    std::vector<size_t> coreCounts;
+    const size_t cpusCount = topology.getCpus().size();
+    for (size_t cores = 1; cores < cpusCount; cores *= 2) {
+        coreCounts.push_back(cores);
+    }
+    coreCounts.push_back(cpusCount);
+    return coreCounts;
 }
 
-DWORD WINAPI DoWithdraw(CONST LPVOID lpParameter) {
-    Withdraw((int)(INT_PTR)lpParameter);
-    return 0;
+// Every chosen lock for every core count and read share: one thread per
+// core, pinned, all on the single balance. CSV on stdout, or in the file
+// given with --csv=.
+int RunLockBenchmark(const LedgerBenchOptions& options) {
+    std::vector<LockStrategy> strategies;
+    for (const LockStrategy& strategy : GetLockStrategies()) {
+        if (options.lockNames.empty()
+            || std::find(options.lockNames.begin(), options.lockNames.end(), strategy.name) != options.lockNames.end()) {
+            strategies.push_back(strategy);
+        }
+    }
+    if (strategies.empty()) {
+        std::cerr << "No such lock; choose from mutex, ttas, ticket, mcs, shared, atomic" << std::endl;
+        return 1;
+    }
+
+    const CpuTopology topology = CpuTopology::Detect();
+    const std::vector<size_t> coreCounts = SelectCoreCounts(options, topology);
+
+    std::ofstream file;
+    if (!options.benchmark.csvPath.empty()) {
+        file.open(options.benchmark.csvPath);
+        if (!file) {
+            std::cerr << "Cannot open file: " << options.benchmark.csvPath << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& csv = options.benchmark.csvPath.empty() ? std::cout : file;
+    csv << "lock,cores,read_pct,ops,ops_per_s,p50_ns,p90_ns,p99_ns,p999_ns,max_ns,balanced" << std::endl;
+
+    bool allBalanced = true;
+    for (const LockStrategy& strategy : strategies) {
+        for (size_t cores : coreCounts) {
+            for (size_t readPercent : options.readPercents) {
+                LockBenchConfig config;
+                config.threadsCount = static_cast<int>(cores);
+                config.readPercent = static_cast<int>(std::min<size_t>(readPercent, 100));
+                config.operationsCount = options.operationsCount;
+                config.cpus = PlanPlacement(topology, Placement(), config.threadsCount);
+
+                const LockBenchResult result = strategy.run(config);
+                allBalanced = allBalanced && result.balanced;
+                csv << strategy.name << "," << cores << "," << config.readPercent << "," << result.operationsCount << ","
+                    << result.getThroughput() << "," << result.getPercentile(50) << "," << result.getPercentile(90) << ","
+                    << result.getPercentile(99) << "," << result.getPercentile(99.9) << ","
+                    << (result.latenciesNs.empty() ? 0 : result.latenciesNs.back()) << ","
+                    << (result.balanced ? "yes" : "NO") << std::endl;
+            }
+        }
+    }
+    return allBalanced ? 0 : 1;
 }
 
-int _tmain(int argc, _TCHAR* argv[]) {
-    HANDLE* handles = new HANDLE[50];
+// Random transfers of 1..200 between any two accounts, from one pinned
+// thread per core, with --reads percent of the operations reading a single
+// balance optimistically instead. Meanwhile an auditor thread keeps taking
+// consistent totals, each of which must equal the money the ledger started
+// with; at the end no balance may be negative. CSV as for --lock-bench.
+int RunTransferStress(const LedgerBenchOptions& options) {
+    constexpr int64_t INITIAL_BALANCE = 100;
+    const CpuTopology topology = CpuTopology::Detect();
+    const int64_t expectedTotal = INITIAL_BALANCE * static_cast<int64_t>(options.accountsCount);
 
-    InitializeCriticalSection(&FileLockingCriticalSection);
+    std::ofstream file;
+    if (!options.benchmark.csvPath.empty()) {
+        file.open(options.benchmark.csvPath);
+        if (!file) {
+            std::cerr << "Cannot open file: " << options.benchmark.csvPath << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& csv = options.benchmark.csvPath.empty() ? std::cout : file;
+    csv << "cores,read_pct,accounts,shards,ops,ops_per_s,rejected,read_fallbacks,audits,audit_fallbacks,"
+        "audit_failures,lowest,conserved" << std::endl;
 
-    WriteToFile(0);
+    bool allPassed = true;
+    for (size_t cores : SelectCoreCounts(options, topology)) {
+        for (size_t readPercent : options.readPercents) {
+            ShardedLedger ledger(options.accountsCount, options.shardsCount, INITIAL_BALANCE);
+            const int threadsCount = static_cast<int>(cores);
+            const std::vector<int> cpus = PlanPlacement(topology, Placement(), threadsCount);
+            std::atomic<int> readyCount{ 0 };
+            std::atomic<bool> started{ false };
+            std::atomic<bool> finished{ false };
+            std::atomic<uint64_t> rejectedCount{ 0 };
+            std::atomic<uint64_t> readFallbacksCount{ 0 };
+            std::atomic<int64_t> readsSink{ 0 };
+            uint64_t auditsCount = 0;
+            uint64_t auditFallbacksCount = 0;
+            uint64_t auditFailuresCount = 0;
 
-    SetProcessAffinityMask(GetCurrentProcess(), 1);
-    for (int i = 0; i < 50; i++) {
-        handles[i] = (i % 2 == 0)
-            ? CreateThread(NULL, 0, &DoDeposit, (LPVOID)(INT_PTR)230, CREATE_SUSPENDED, NULL)
-            : CreateThread(NULL, 0, &DoWithdraw, (LPVOID)(INT_PTR)1000, CREATE_SUSPENDED, NULL);
-        ResumeThread(handles[i]);
+            Thread auditor([&]() {
+                while (!finished.load(std::memory_order_acquire)) {
+                    int attempts = 0;
+                    const int64_t total = ledger.GetTotal(&attempts);
+                    ++auditsCount;
+                    auditFallbacksCount += attempts > ShardedLedger::MAX_OPTIMISTIC_ATTEMPTS;
+                    auditFailuresCount += total != expectedTotal;
+                }
+            });
+
+            std::vector<Thread> workers;
+            workers.reserve(threadsCount);
+            for (int i = 0; i < threadsCount; i++) {
+                workers.emplace_back([&, i]() {
+                    PinCurrentThread(cpus[i]);
+                    uint64_t state = static_cast<uint64_t>(i + 1) << 32;
+                    uint64_t rejected = 0;
+                    uint64_t fallbacks = 0;
+                    int64_t sink = 0;
+
+                    readyCount.fetch_add(1, std::memory_order_release);
+                    SpinWait wait;
+                    while (!started.load(std::memory_order_acquire)) {
+                        wait.Pause();
+                    }
+
+                    for (int operation = 0; operation < options.operationsCount; operation++) {
+                        const uint64_t random = NextRandom(state);
+                        const size_t from = static_cast<size_t>(random % options.accountsCount);
+                        if (static_cast<size_t>(random >> 56) * 100 < readPercent * 256) {
+                            int attempts = 0;
+                            sink += ledger.GetBalance(from, &attempts);
+                            fallbacks += attempts > ShardedLedger::MAX_OPTIMISTIC_ATTEMPTS;
+                            continue;
+                        }
+                        const size_t to = static_cast<size_t>((random >> 20) % options.accountsCount);
+                        const int64_t amount = 1 + static_cast<int64_t>((random >> 40) % 200);
+                        rejected += !ledger.Transfer(from, to, amount);
+                    }
+                    rejectedCount += rejected;
+                    readFallbacksCount += fallbacks;
+                    readsSink.fetch_add(sink, std::memory_order_relaxed);
+                });
+            }
+
+            SpinWait wait;
+            while (readyCount.load(std::memory_order_acquire) < threadsCount) {
+                wait.Pause();
+            }
+            const auto start = std::chrono::steady_clock::now();
+            started.store(true, std::memory_order_release);
+            for (Thread& worker : workers) {
+                worker.Join();
+            }
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            finished.store(true, std::memory_order_release);
+            auditor.Join();
+
+            const int64_t lowest = ledger.getLowestBalance();
+            const bool conserved = ledger.GetTotal() == expectedTotal && auditFailuresCount == 0;
+            allPassed = allPassed && conserved && lowest >= 0;
+
+            const double operations = static_cast<double>(threadsCount) * options.operationsCount;
+            csv << cores << "," << readPercent << "," << options.accountsCount << "," << ledger.getShardsCount() << ","
+                << operations << "," << operations / seconds << "," << rejectedCount.load() << ","
+                << readFallbacksCount.load() << "," << auditsCount << "," << auditFallbacksCount << ","
+                << auditFailuresCount << "," << lowest << "," << (conserved ? "yes" : "NO") << std::endl;
+        }
     }
+    return allPassed ? 0 : 1;
+}
 
-    WaitForMultipleObjects(50, handles, TRUE, INFINITE);
+std::vector<std::string> ParseNames(const std::string& list) {
+    std::vector<std::string> names;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        names.push_back(item);
+    }
+    return names;
+}
 
-    int finalBalance = GetBalance();
-    printf("Final Balance: %d\n", finalBalance);
+std::vector<size_t> ParseSizes(const std::string& list) {
+    std::vector<size_t> sizes;
+    for (const std::string& item : ParseNames(list)) {
+        sizes.push_back(std::stoull(item));
+    }
+    return sizes;
+}
 
-    std::cout << "Press Enter to exit..." << std::endl;
-    std::cin.get();
+// Usage: Lab5
+//        Lab5 --bench [--accounts=N] [--threads=N] [--ops=N] [--snapshot=path] [harness flags]
+//        Lab5 --log-bench [--accounts=N] [--threads=N] [--ops=N] [--batches=1,8,...] [--log=path] [harness flags]
+//        Lab5 --shm-stress [--accounts=N] [--processes=N] [--ops=N] [--kill]
+//        Lab5 --lock-bench [--locks=mutex,ttas,ticket,mcs,shared,atomic] [--cores=1,2,...] [--reads=0,50,90]
+//             [--ops=N] [--csv=path]
+//        Lab5 --transfer-stress [--accounts=N] [--shards=N] [--cores=1,2,...] [--reads=0,50,90] [--ops=N] [--csv=path]
+// Without arguments the lab runs its original deposit/withdraw scenario;
+// --bench measures ledger throughput with many accounts and threads,
+// --log-bench the throughput of logged operations per batch limit and
+// sync policy, --shm-stress several processes sharing one ledger (POSIX
+// only), --lock-bench the single balance under each kind of lock, and
+// --transfer-stress concurrent transfers between many sharded accounts.
+int main(int argc, char* argv[]) {
+    if (argc == 1) {
+        return RunScenario();
+    }
 
-    DeleteCriticalSection(&FileLockingCriticalSection);
-    delete[] handles;
+    LedgerBenchOptions options;
+    options.benchmark.samplesCount = 5;
+    bool benchmark = false;
+    bool logBenchmark = false;
+    bool sharedStress = false;
+    bool lockBenchmark = false;
+    bool transferStress = false;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--bench") {
+            benchmark = true;
+        }
+        else if (arg == "--log-bench") {
+            logBenchmark = true;
+        }
+        else if (arg == "--shm-stress") {
+            sharedStress = true;
+        }
+        else if (arg.rfind("--processes=", 0) == 0) {
+            options.processesCount = std::max(1, std::stoi(arg.substr(strlen("--processes="))));
+        }
+        else if (arg == "--kill") {
+            options.killHolder = true;
+        }
+        else if (arg == "--lock-bench") {
+            lockBenchmark = true;
+        }
+        else if (arg == "--transfer-stress") {
+            transferStress = true;
+        }
+        else if (arg.rfind("--shards=", 0) == 0) {
+            options.shardsCount = std::max(1ull, std::stoull(arg.substr(strlen("--shards="))));
+        }
+        else if (arg.rfind("--locks=", 0) == 0) {
+            options.lockNames = ParseNames(arg.substr(strlen("--locks=")));
+        }
+        else if (arg.rfind("--cores=", 0) == 0) {
+            options.coreCounts = ParseSizes(arg.substr(strlen("--cores=")));
+        }
+        else if (arg.rfind("--reads=", 0) == 0) {
+            options.readPercents = ParseSizes(arg.substr(strlen("--reads=")));
+        }
+        else if (arg.rfind("--batches=", 0) == 0) {
+            options.batchSizes = ParseSizes(arg.substr(strlen("--batches=")));
+        }
+        else if (arg.rfind("--log=", 0) == 0) {
+            options.logPath = arg.substr(strlen("--log="));
+        }
+        else if (arg.rfind("--snapshot=", 0) == 0) {
+            options.snapshotPath = arg.substr(strlen("--snapshot="));
+        }
+        else if (arg.rfind("--accounts=", 0) == 0) {
+            options.accountsCount = std::max(1ull, std::stoull(arg.substr(strlen("--accounts="))));
+        }
+        else if (arg.rfind("--threads=", 0) == 0) {
+            options.threadsCount = std::max(1, std::stoi(arg.substr(strlen("--threads="))));
+        }
+        else if (arg.rfind("--ops=", 0) == 0) {
+            options.operationsCount = std::max(1, std::stoi(arg.substr(strlen("--ops="))));
+        }
+        else if (!options.benchmark.ParseFlag(arg)) {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [--bench | --log-bench [--batches=1,8,...] [--log=path]"
+                << " | --shm-stress [--processes=N] [--kill] | --lock-bench [--locks=...] | --transfer-stress [--shards=N]]"
+                << " [--cores=1,2,...] [--reads=0,50,...] [--snapshot=path]"
+                << " [--accounts=N] [--threads=N] [--ops=N] "
+                << BenchmarkOptions::getUsage() << std::endl;
+            return 1;
+        }
+    }
 
-    return 0;
-}
\ No newline at end of file
+    if (transferStress) {
+        options.operationsCount = options.operationsCount ? options.operationsCount : 1 << 18;
+        return RunTransferStress(options);
+    }
+    if (lockBenchmark) {
+        options.operationsCount = options.operationsCount ? options.operationsCount : 100000;
+        return RunLockBenchmark(options);
+    }
+    if (sharedStress) {
+        options.operationsCount = options.operationsCount ? options.operationsCount : 1 << 20;
+#ifdef _WIN32
+        std::cerr << "--shm-stress needs POSIX shared memory" << std::endl;
+        return 1;
+#else
+        try {
+            return RunSharedStress(options);
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+#endif
+    }
+    if (logBenchmark) {
+        options.threadsCount = options.threadsCount ? options.threadsCount : 64;
+        options.operationsCount = options.operationsCount ? options.operationsCount : 200;
+        try {
+            return RunLogBenchmark(options);
+        }
+        catch (const std::exception& error) {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+    }
+    if (benchmark) {
+        options.threadsCount = options.threadsCount ? options.threadsCount
+            : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        options.operationsCount = options.operationsCount ? options.operationsCount : 1 << 20;
+        return RunLedgerBenchmark(options);
+    }
+    std::cerr << "Options need --bench, --log-bench, --shm-stress, --lock-bench or --transfer-stress" << std::endl;
+    return 1;
+}
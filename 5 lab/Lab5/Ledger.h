@@ -0,0 +1,171 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Balances of many accounts held in memory. Deposits are a single atomic
+// add; withdrawals retry a compare-and-swap until they either succeed or
+// see too little money, so no operation ever takes a lock or touches a file.
+class Ledger {
+public:
+    explicit Ledger(size_t accountsCount, int64_t initialBalance = 0)
+        : accountsCount(accountsCount), accounts(new Account[accountsCount]) {
+        for (size_t i = 0; i < accountsCount; ++i) {
+            accounts[i].balance.store(initialBalance, std::memory_order_relaxed);
+        }
+    }
+
+    Ledger(const Ledger&) = delete;
+    Ledger& operator=(const Ledger&) = delete;
+
+    size_t getAccountsCount() const {
+        return accountsCount;
+    }
+
+    // Returns the balance after the deposit.
+    int64_t Deposit(size_t account, int64_t amount) {
+        return accounts[account].balance.fetch_add(amount, std::memory_order_acq_rel) + amount;
+    }
+
+    // Takes amount only if the account holds at least that much. On success
+    // balanceAfter gets the new balance, otherwise the one that was too low.
+    bool Withdraw(size_t account, int64_t amount, int64_t* balanceAfter = nullptr) {
+        std::atomic<int64_t>& balance = accounts[account].balance;
+        int64_t current = balance.load(std::memory_order_acquire);
+        while (current >= amount) {
+            // A failed exchange reloads current, so the loop re-checks the funds
+            if (balance.compare_exchange_weak(current, current - amount,
+                std::memory_order_acq_rel, std::memory_order_acquire)) {
+                if (balanceAfter) {
+                    *balanceAfter = current - amount;
+                }
+                return true;
+            }
+        }
+        if (balanceAfter) {
+            *balanceAfter = current;
+        }
+        return false;
+    }
+
+    int64_t GetBalance(size_t account) const {
+        return accounts[account].balance.load(std::memory_order_acquire);
+    }
+
+    // Every balance is one that account really had, but operations running
+    // meanwhile may show up in some accounts and not yet in others.
+    std::vector<int64_t> Snapshot() const {
+        std::vector<int64_t> balances(accountsCount);
+        for (size_t i = 0; i < accountsCount; ++i) {
+            balances[i] = accounts[i].balance.load(std::memory_order_acquire);
+        }
+        return balances;
+    }
+
+    int64_t getTotal() const {
+        int64_t total = 0;
+        for (int64_t balance : Snapshot()) {
+            total += balance;
+        }
+        return total;
+    }
+
+private:
+    // A line per account, so threads busy with neighbouring accounts do not
+    // invalidate each other's caches.
+    struct alignas(64) Account {
+        std::atomic<int64_t> balance{ 0 };
+    };
+
+    size_t accountsCount;
+    std::unique_ptr<Account[]> accounts;
+};
+
+// Writes every balance of ledger, one per line, to path + ".tmp" and
+// renames it over path, so readers never see a half-written file. Returns
+// false, leaving path alone, if the file could not be written.
+inline bool WriteLedgerSnapshot(const Ledger& ledger, const std::string& path) {
+    const std::vector<int64_t> balances = ledger.Snapshot();
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios_base::out | std::ios_base::trunc);
+        for (int64_t balance : balances) {
+            file << balance << '\n';
+        }
+        if (!file.flush()) {
+            return false;
+        }
+    }
+#ifdef _WIN32
+    // std::rename does not replace an existing file here
+    std::remove(path.c_str());
+#endif
+    return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+// Saves the ledger to a file from a background thread, every interval and
+// whenever RequestSnapshot is called, and once more on destruction, with
+// WriteLedgerSnapshot. The ledger stays the source of truth; the file is
+// only as fresh as the last snapshot.
+class SnapshotWriter {
+public:
+    SnapshotWriter(const Ledger& ledger, std::string path, std::chrono::milliseconds interval)
+        : ledger(ledger), path(std::move(path)), interval(interval), writer(&SnapshotWriter::WriterLoop, this) {
+    }
+
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    ~SnapshotWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_one();
+        writer.join();
+    }
+
+    void RequestSnapshot() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requested = true;
+        }
+        wakeUp.notify_one();
+    }
+
+private:
+    void WriterLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wakeUp.wait_for(lock, interval, [this] { return requested || stopping; });
+            const bool last = stopping;
+            requested = false;
+
+            lock.unlock();
+            WriteLedgerSnapshot(ledger, path);
+            lock.lock();
+
+            if (last) {
+                return;
+            }
+        }
+    }
+
+    const Ledger& ledger;
+    std::string path;
+    std::chrono::milliseconds interval;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool requested = false;
+    bool stopping = false;
+    std::thread writer;
+};
@@ -0,0 +1,206 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include "Ledger.h"
+#include "Locks.h"
+#include "../../common/Threading.h"
+
+// The lab's bank scenario, one balance hit by every thread, run with a
+// choice of synchronization. Each operation is a balance read with
+// probability readPercent, otherwise a deposit or withdrawal of 1..100.
+
+struct LockBenchConfig {
+    int threadsCount = 1;
+    int readPercent = 0;
+    int operationsCount = 100000;
+    // CPU for worker i; empty leaves the workers unpinned
+    std::vector<int> cpus;
+};
+
+struct LockBenchResult {
+    double seconds = 0.0;
+    uint64_t operationsCount = 0;
+    // Per operation, sorted ascending; includes the cost of reading the clock
+    std::vector<uint32_t> latenciesNs;
+    // The final balance equals the initial one plus deposits minus withdrawals
+    bool balanced = false;
+
+    double getThroughput() const {
+        return seconds > 0.0 ? operationsCount / seconds : 0.0;
+    }
+
+    uint32_t getPercentile(double p) const {
+        if (latenciesNs.empty()) {
+            return 0;
+        }
+        const size_t index = static_cast<size_t>(p / 100.0 * (latenciesNs.size() - 1) + 0.5);
+        return latenciesNs[std::min(index, latenciesNs.size() - 1)];
+    }
+};
+
+// The balance behind any BasicLockable. Reads take the lock shared when it
+// offers that, as std::shared_mutex does, and exclusively otherwise.
+template <typename Lock>
+class LockedAccount {
+public:
+    explicit LockedAccount(int64_t initialBalance) : balance(initialBalance) {
+    }
+
+    int64_t GetBalance() {
+        if constexpr (requires(Lock& lock) { lock.lock_shared(); }) {
+            std::shared_lock<Lock> guard(lock);
+            return balance;
+        }
+        else {
+            std::lock_guard<Lock> guard(lock);
+            return balance;
+        }
+    }
+
+    void Deposit(int64_t amount) {
+        std::lock_guard<Lock> guard(lock);
+        balance += amount;
+    }
+
+    bool Withdraw(int64_t amount) {
+        std::lock_guard<Lock> guard(lock);
+        if (balance < amount) {
+            return false;
+        }
+        balance -= amount;
+        return true;
+    }
+
+private:
+    Lock lock;
+    int64_t balance;
+};
+
+// Lock-free: the balance is one Ledger account, updated by atomic add and
+// compare-and-swap.
+class AtomicAccount {
+public:
+    explicit AtomicAccount(int64_t initialBalance) : ledger(1, initialBalance) {
+    }
+
+    int64_t GetBalance() {
+        return ledger.GetBalance(0);
+    }
+
+    void Deposit(int64_t amount) {
+        ledger.Deposit(0, amount);
+    }
+
+    bool Withdraw(int64_t amount) {
+        return ledger.Withdraw(0, amount);
+    }
+
+private:
+    Ledger ledger;
+};
+
+template <typename Account>
+LockBenchResult RunLockWorkload(const LockBenchConfig& config) {
+    constexpr int64_t INITIAL_BALANCE = 1000;
+    Account account(INITIAL_BALANCE);
+    std::vector<std::vector<uint32_t>> latencies(config.threadsCount);
+    std::vector<int64_t> netDeposits(config.threadsCount, 0);
+    std::atomic<int> readyCount{ 0 };
+    std::atomic<bool> started{ false };
+    // Keeps the reads from being optimized away
+    std::atomic<int64_t> readsSink{ 0 };
+
+    std::vector<Thread> workers;
+    workers.reserve(config.threadsCount);
+    for (int i = 0; i < config.threadsCount; i++) {
+        workers.emplace_back([&, i]() {
+            if (!config.cpus.empty()) {
+                PinCurrentThread(config.cpus[i % config.cpus.size()]);
+            }
+            std::vector<uint32_t>& times = latencies[i];
+            times.reserve(config.operationsCount);
+            uint64_t state = static_cast<uint64_t>(i + 1) * 0x9E3779B97F4A7C15ull;
+            int64_t net = 0;
+            int64_t sink = 0;
+
+            readyCount.fetch_add(1, std::memory_order_release);
+            SpinWait wait;
+            while (!started.load(std::memory_order_acquire)) {
+                wait.Pause();
+            }
+
+            for (int operation = 0; operation < config.operationsCount; operation++) {
+                // xorshift64: the generator must not cost more than the operation
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                const int64_t amount = 1 + static_cast<int64_t>(state >> 40) % 100;
+                const bool read = static_cast<int>(state % 100) < config.readPercent;
+
+                const auto begin = std::chrono::steady_clock::now();
+                if (read) {
+                    sink += account.GetBalance();
+                }
+                else if (state >> 63) {
+                    account.Deposit(amount);
+                    net += amount;
+                }
+                else if (account.Withdraw(amount)) {
+                    net -= amount;
+                }
+                const auto end = std::chrono::steady_clock::now();
+                times.push_back(static_cast<uint32_t>(std::min<int64_t>(UINT32_MAX,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count())));
+            }
+            netDeposits[i] = net;
+            readsSink.fetch_add(sink, std::memory_order_relaxed);
+        });
+    }
+
+    // Every worker is pinned and waiting, so none gets a head start
+    SpinWait wait;
+    while (readyCount.load(std::memory_order_acquire) < config.threadsCount) {
+        wait.Pause();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    started.store(true, std::memory_order_release);
+    for (Thread& worker : workers) {
+        worker.Join();
+    }
+    const auto finish = std::chrono::steady_clock::now();
+
+    LockBenchResult result;
+    result.seconds = std::chrono::duration<double>(finish - start).count();
+    result.operationsCount = static_cast<uint64_t>(config.threadsCount) * config.operationsCount;
+    int64_t expected = INITIAL_BALANCE;
+    for (int i = 0; i < config.threadsCount; i++) {
+        expected += netDeposits[i];
+        result.latenciesNs.insert(result.latenciesNs.end(), latencies[i].begin(), latencies[i].end());
+    }
+    std::sort(result.latenciesNs.begin(), result.latenciesNs.end());
+    result.balanced = account.GetBalance() == expected;
+    return result;
+}
+
+struct LockStrategy {
+    const char* name;
+    LockBenchResult (*run)(const LockBenchConfig&);
+};
+
+inline const std::vector<LockStrategy>& GetLockStrategies() {
+    static const std::vector<LockStrategy> STRATEGIES = {
+        { "mutex", &RunLockWorkload<LockedAccount<std::mutex>> },
+        { "ttas", &RunLockWorkload<LockedAccount<TtasSpinLock>> },
+        { "ticket", &RunLockWorkload<LockedAccount<TicketLock>> },
+        { "mcs", &RunLockWorkload<LockedAccount<McsLock>> },
+        { "shared", &RunLockWorkload<LockedAccount<std::shared_mutex>> },
+        { "atomic", &RunLockWorkload<AtomicAccount> }
+    };
+    return STRATEGIES;
+}
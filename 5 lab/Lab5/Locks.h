@@ -0,0 +1,136 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include "../../common/Threading.h"
+
+// Hand-written locks for the lock benchmark. All of them are BasicLockable,
+// so they drop into std::lock_guard like std::mutex does.
+
+// Waiting step for the spinning locks: pause for a while, then yield. With
+// more threads than cores the holder may be descheduled, and a waiter that
+// never yields would burn its whole time slice before the holder runs again.
+class SpinWait {
+public:
+    void Pause() {
+        if (spins < YIELD_AFTER) {
+            ++spins;
+            CpuRelax();
+        }
+        else {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    static constexpr int YIELD_AFTER = 1000;
+    int spins = 0;
+};
+
+// Test-and-test-and-set: waiters watch the flag in their own cache and only
+// try the exchange once it reads clear. A waiter that loses the exchange
+// backs off for twice as long as last time, so a released lock is not
+// stormed by every waiter at once.
+class TtasSpinLock {
+public:
+    void lock() {
+        int backoff = 1;
+        while (true) {
+            SpinWait wait;
+            while (locked.load(std::memory_order_relaxed)) {
+                wait.Pause();
+            }
+            if (!locked.exchange(true, std::memory_order_acquire)) {
+                return;
+            }
+            for (int i = 0; i < backoff; ++i) {
+                CpuRelax();
+            }
+            backoff = std::min(backoff * 2, MAX_BACKOFF);
+        }
+    }
+
+    void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+
+private:
+    static constexpr int MAX_BACKOFF = 1024;
+    std::atomic<bool> locked{ false };
+};
+
+// First come, first served: a thread draws a ticket and waits for it to be
+// called. Fair, but all waiters poll the same line, and a descheduled
+// thread next in line holds up everyone behind it.
+class TicketLock {
+public:
+    void lock() {
+        const uint32_t ticket = next.fetch_add(1, std::memory_order_relaxed);
+        SpinWait wait;
+        while (serving.load(std::memory_order_acquire) != ticket) {
+            wait.Pause();
+        }
+    }
+
+    void unlock() {
+        // Only the holder writes serving
+        serving.store(serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    alignas(64) std::atomic<uint32_t> next{ 0 };
+    alignas(64) std::atomic<uint32_t> serving{ 0 };
+};
+
+// Mellor-Crummey and Scott queue lock: waiters form a linked queue and each
+// spins on the flag in its own node, so a handoff writes only to the
+// successor's cache line. The nodes are thread-local, so a thread may hold
+// one McsLock at a time.
+class McsLock {
+public:
+    void lock() {
+        Node& node = LocalNode();
+        node.next.store(nullptr, std::memory_order_relaxed);
+        node.waiting.store(true, std::memory_order_relaxed);
+
+        Node* predecessor = tail.exchange(&node, std::memory_order_acq_rel);
+        if (predecessor) {
+            predecessor->next.store(&node, std::memory_order_release);
+            SpinWait wait;
+            while (node.waiting.load(std::memory_order_acquire)) {
+                wait.Pause();
+            }
+        }
+    }
+
+    void unlock() {
+        Node& node = LocalNode();
+        Node* successor = node.next.load(std::memory_order_acquire);
+        if (!successor) {
+            Node* expected = &node;
+            if (tail.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                return;
+            }
+            // A successor swapped itself in but has not linked its node yet
+            SpinWait wait;
+            while (!(successor = node.next.load(std::memory_order_acquire))) {
+                wait.Pause();
+            }
+        }
+        successor->waiting.store(false, std::memory_order_release);
+    }
+
+private:
+    struct alignas(64) Node {
+        std::atomic<Node*> next{ nullptr };
+        std::atomic<bool> waiting{ false };
+    };
+
+    static Node& LocalNode() {
+        thread_local Node node;
+        return node;
+    }
+
+    alignas(64) std::atomic<Node*> tail{ nullptr };
+};
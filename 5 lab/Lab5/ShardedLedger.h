@@ -0,0 +1,202 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Locks.h"
+
+// Accounts spread over shards (account a lives in shard a % shardsCount),
+// each with its own lock, so transfers between accounts of different
+// shards run in parallel. A transfer locks its one or two shards in
+// ascending shard order; every thread agrees on that order, so no two
+// transfers can each hold the lock the other waits for.
+//
+// Every shard also carries a version that is odd while a writer is inside
+// and bumped again when it leaves (a seqlock). Readers take no lock: they
+// read the versions, the balances, and the versions again, and retry if
+// anything moved. After MAX_OPTIMISTIC_ATTEMPTS they lock like a writer.
+class ShardedLedger {
+public:
+    static constexpr int MAX_OPTIMISTIC_ATTEMPTS = 8;
+
+    ShardedLedger(size_t accountsCount, size_t shardsCount, int64_t initialBalance)
+        : accountsCount(accountsCount), shardsCount(std::max<size_t>(1, std::min(shardsCount, accountsCount))),
+        shards(new Shard[this->shardsCount]) {
+        for (size_t s = 0; s < this->shardsCount; ++s) {
+            // Accounts s, s + shardsCount, s + 2 * shardsCount, ...
+            const size_t size = (accountsCount - s + this->shardsCount - 1) / this->shardsCount;
+            shards[s].size = size;
+            shards[s].balances = std::make_unique<std::atomic<int64_t>[]>(size);
+            for (size_t i = 0; i < size; ++i) {
+                shards[s].balances[i].store(initialBalance, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    ShardedLedger(const ShardedLedger&) = delete;
+    ShardedLedger& operator=(const ShardedLedger&) = delete;
+
+    size_t getAccountsCount() const {
+        return accountsCount;
+    }
+
+    size_t getShardsCount() const {
+        return shardsCount;
+    }
+
+    // Moves amount from one account to another unless that would leave the
+    // source negative.
+    bool Transfer(size_t from, size_t to, int64_t amount) {
+        const size_t fromShard = from % shardsCount;
+        const size_t toShard = to % shardsCount;
+        Shard& first = shards[std::min(fromShard, toShard)];
+        Shard& second = shards[std::max(fromShard, toShard)];
+
+        std::unique_lock<TtasSpinLock> firstLock(first.lock);
+        std::unique_lock<TtasSpinLock> secondLock;
+        if (&second != &first) {
+            secondLock = std::unique_lock<TtasSpinLock>(second.lock);
+        }
+
+        std::atomic<int64_t>& source = Balance(from);
+        std::atomic<int64_t>& target = Balance(to);
+        const int64_t sourceBalance = source.load(std::memory_order_relaxed);
+        if (sourceBalance < amount) {
+            return false;
+        }
+        if (from == to) {
+            return true;
+        }
+
+        BeginWrite(first);
+        if (&second != &first) {
+            BeginWrite(second);
+        }
+        source.store(sourceBalance - amount, std::memory_order_relaxed);
+        target.store(target.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        EndWrite(first);
+        if (&second != &first) {
+            EndWrite(second);
+        }
+        return true;
+    }
+
+    // attempts, if given, gets the number of optimistic tries; one more than
+    // MAX_OPTIMISTIC_ATTEMPTS means the read fell back to the lock.
+    int64_t GetBalance(size_t account, int* attempts = nullptr) {
+        Shard& shard = shards[account % shardsCount];
+        for (int attempt = 1; attempt <= MAX_OPTIMISTIC_ATTEMPTS; ++attempt) {
+            const uint64_t version = shard.version.load(std::memory_order_acquire);
+            if (version & 1) {
+                CpuRelax();
+                continue;
+            }
+            const int64_t balance = Balance(account).load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (shard.version.load(std::memory_order_relaxed) == version) {
+                if (attempts) {
+                    *attempts = attempt;
+                }
+                return balance;
+            }
+        }
+
+        if (attempts) {
+            *attempts = MAX_OPTIMISTIC_ATTEMPTS + 1;
+        }
+        std::lock_guard<TtasSpinLock> lock(shard.lock);
+        return Balance(account).load(std::memory_order_relaxed);
+    }
+
+    // The sum of all balances at one instant: no transfer is half counted.
+    // The lock fallback takes every shard in ascending order, as transfers do.
+    int64_t GetTotal(int* attempts = nullptr) {
+        std::vector<uint64_t> versions(shardsCount);
+        for (int attempt = 1; attempt <= MAX_OPTIMISTIC_ATTEMPTS; ++attempt) {
+            bool writing = false;
+            for (size_t s = 0; s < shardsCount && !writing; ++s) {
+                versions[s] = shards[s].version.load(std::memory_order_acquire);
+                writing = versions[s] & 1;
+            }
+            if (writing) {
+                CpuRelax();
+                continue;
+            }
+
+            const int64_t total = SumBalances();
+            std::atomic_thread_fence(std::memory_order_acquire);
+            bool unchanged = true;
+            for (size_t s = 0; s < shardsCount && unchanged; ++s) {
+                unchanged = shards[s].version.load(std::memory_order_relaxed) == versions[s];
+            }
+            if (unchanged) {
+                if (attempts) {
+                    *attempts = attempt;
+                }
+                return total;
+            }
+        }
+
+        if (attempts) {
+            *attempts = MAX_OPTIMISTIC_ATTEMPTS + 1;
+        }
+        for (size_t s = 0; s < shardsCount; ++s) {
+            shards[s].lock.lock();
+        }
+        const int64_t total = SumBalances();
+        for (size_t s = shardsCount; s-- > 0;) {
+            shards[s].lock.unlock();
+        }
+        return total;
+    }
+
+    // Not synchronized: for checks once every transfer has finished.
+    int64_t getLowestBalance() const {
+        int64_t lowest = INT64_MAX;
+        for (size_t s = 0; s < shardsCount; ++s) {
+            for (size_t i = 0; i < shards[s].size; ++i) {
+                lowest = std::min(lowest, shards[s].balances[i].load(std::memory_order_relaxed));
+            }
+        }
+        return lowest;
+    }
+
+private:
+    struct alignas(64) Shard {
+        TtasSpinLock lock;
+        std::atomic<uint64_t> version{ 0 };
+        size_t size = 0;
+        std::unique_ptr<std::atomic<int64_t>[]> balances;
+    };
+
+    std::atomic<int64_t>& Balance(size_t account) {
+        return shards[account % shardsCount].balances[account / shardsCount];
+    }
+
+    int64_t SumBalances() const {
+        int64_t total = 0;
+        for (size_t s = 0; s < shardsCount; ++s) {
+            for (size_t i = 0; i < shards[s].size; ++i) {
+                total += shards[s].balances[i].load(std::memory_order_relaxed);
+            }
+        }
+        return total;
+    }
+
+    // Only the holder of the shard's lock writes its version
+    static void BeginWrite(Shard& shard) {
+        shard.version.store(shard.version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    static void EndWrite(Shard& shard) {
+        shard.version.store(shard.version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    size_t accountsCount;
+    size_t shardsCount;
+    std::unique_ptr<Shard[]> shards;
+};
@@ -0,0 +1,279 @@
+#pragma once
+// POSIX shared memory and robust mutexes have no Win32 counterpart here;
+// on Windows Lab5 keeps to the in-process ledger.
+#ifndef _WIN32
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../../common/Threading.h"
+
+// Balances of many accounts in a named POSIX shared-memory segment, so any
+// number of processes can work on one ledger. A single process-shared
+// robust mutex guards the segment. Locking first spins on trylock, which
+// is a plain atomic exchange in user space, and only then blocks in the
+// kernel futex. If a process dies holding the mutex, the next locker gets
+// EOWNERDEAD and rolls the dead holder's half-done update forward from a
+// journal before marking the mutex consistent again.
+class SharedLedger {
+public:
+    // Trylock attempts before blocking: a few microseconds, longer than
+    // the critical section of one operation
+    static constexpr int SPIN_COUNT = 200;
+
+    struct Totals {
+        int64_t initial;
+        int64_t balance;
+        int64_t deposited;
+        int64_t withdrawn;
+        int64_t lowestBalance;
+        uint64_t operationsCount;
+        uint64_t rejectedCount;
+        // Acquisitions that gave up spinning and slept in the kernel
+        uint64_t contendedCount;
+        // Times a dead holder's mutex was recovered
+        uint64_t recoveriesCount;
+    };
+
+    // Fails if a segment of that name already exists. Names start with a
+    // slash, as shm_open wants.
+    static SharedLedger Create(const std::string& name, size_t accountsCount, int64_t initialBalance) {
+        const int descriptor = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (descriptor < 0) {
+            throw std::runtime_error("Cannot create shared memory " + name + ": " + std::strerror(errno));
+        }
+        const size_t length = BalancesOffset() + accountsCount * sizeof(int64_t);
+        if (ftruncate(descriptor, static_cast<off_t>(length)) != 0) {
+            close(descriptor);
+            shm_unlink(name.c_str());
+            throw std::runtime_error("Cannot size shared memory " + name);
+        }
+
+        SharedLedger ledger(descriptor, length, name);
+        Header* header = ledger.header;
+        header->accountsCount = accountsCount;
+        header->initialTotal = initialBalance * static_cast<int64_t>(accountsCount);
+        for (size_t i = 0; i < accountsCount; ++i) {
+            ledger.balances[i] = initialBalance;
+        }
+
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header->mutex, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+
+        // Published last: Open refuses a segment until it is set up
+        std::atomic_ref<uint64_t>(header->magic).store(MAGIC, std::memory_order_release);
+        return ledger;
+    }
+
+    static SharedLedger Open(const std::string& name) {
+        const int descriptor = shm_open(name.c_str(), O_RDWR, 0);
+        if (descriptor < 0) {
+            throw std::runtime_error("Cannot open shared memory " + name + ": " + std::strerror(errno));
+        }
+        struct stat segmentStat;
+        fstat(descriptor, &segmentStat);
+        const size_t length = static_cast<size_t>(segmentStat.st_size);
+        if (length < BalancesOffset()) {
+            close(descriptor);
+            throw std::runtime_error("Shared memory " + name + " is not a ledger");
+        }
+
+        SharedLedger ledger(descriptor, length, name);
+        if (std::atomic_ref<uint64_t>(ledger.header->magic).load(std::memory_order_acquire) != MAGIC
+            || length < BalancesOffset() + ledger.header->accountsCount * sizeof(int64_t)) {
+            throw std::runtime_error("Shared memory " + name + " is not a ledger");
+        }
+        return ledger;
+    }
+
+    // The segment lives until the last process unmaps it.
+    static void Unlink(const std::string& name) {
+        shm_unlink(name.c_str());
+    }
+
+    SharedLedger(SharedLedger&& other) noexcept
+        : name(std::move(other.name)), length(std::exchange(other.length, 0)),
+        header(std::exchange(other.header, nullptr)), balances(std::exchange(other.balances, nullptr)) {
+    }
+
+    SharedLedger(const SharedLedger&) = delete;
+    SharedLedger& operator=(const SharedLedger&) = delete;
+    SharedLedger& operator=(SharedLedger&&) = delete;
+
+    ~SharedLedger() {
+        if (header) {
+            munmap(header, length);
+        }
+    }
+
+    size_t getAccountsCount() const {
+        return header->accountsCount;
+    }
+
+    void Deposit(size_t account, int64_t amount) {
+        Guard guard(*this);
+        Apply(account, amount);
+    }
+
+    bool Withdraw(size_t account, int64_t amount) {
+        Guard guard(*this);
+        if (balances[account] < amount) {
+            ++header->rejectedCount;
+            return false;
+        }
+        Apply(account, -amount);
+        return true;
+    }
+
+    int64_t GetBalance(size_t account) {
+        Guard guard(*this);
+        return balances[account];
+    }
+
+    // Taken under the lock, so the figures are consistent with each other.
+    Totals getTotals() {
+        Guard guard(*this);
+        Totals totals = { header->initialTotal, 0, header->deposited, header->withdrawn, 0,
+            header->operationsCount, header->rejectedCount, header->contendedCount, header->recoveriesCount };
+        totals.lowestBalance = header->accountsCount ? balances[0] : 0;
+        for (size_t i = 0; i < header->accountsCount; ++i) {
+            totals.balance += balances[i];
+            totals.lowestBalance = std::min(totals.lowestBalance, balances[i]);
+        }
+        return totals;
+    }
+
+private:
+    static constexpr uint64_t MAGIC = 0x4C45444745523035ull;
+
+    // The new values an update is about to store. Written in full before
+    // active is set, so a holder killed at any point leaves either nothing
+    // to do or everything needed to finish its update.
+    struct Journal {
+        uint64_t active;
+        uint64_t account;
+        int64_t balance;
+        int64_t deposited;
+        int64_t withdrawn;
+        uint64_t operationsCount;
+    };
+
+    struct Header {
+        uint64_t magic;
+        uint64_t accountsCount;
+        int64_t initialTotal;
+        pthread_mutex_t mutex;
+        Journal journal;
+        int64_t deposited;
+        int64_t withdrawn;
+        uint64_t operationsCount;
+        uint64_t rejectedCount;
+        uint64_t contendedCount;
+        uint64_t recoveriesCount;
+    };
+
+    class Guard {
+    public:
+        explicit Guard(SharedLedger& ledger) : ledger(ledger) {
+            ledger.Lock();
+        }
+
+        ~Guard() {
+            pthread_mutex_unlock(&ledger.header->mutex);
+        }
+
+    private:
+        SharedLedger& ledger;
+    };
+
+    // Balances start on their own cache line, away from the mutex
+    static size_t BalancesOffset() {
+        return (sizeof(Header) + 63) / 64 * 64;
+    }
+
+    SharedLedger(int descriptor, size_t length, std::string name) : name(std::move(name)), length(length) {
+        void* address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+        close(descriptor);
+        if (address == MAP_FAILED) {
+            throw std::runtime_error("Cannot map shared memory " + this->name);
+        }
+        header = static_cast<Header*>(address);
+        balances = reinterpret_cast<int64_t*>(static_cast<char*>(address) + BalancesOffset());
+    }
+
+    void Lock() {
+        int result = EBUSY;
+        for (int spin = 0; spin < SPIN_COUNT && result == EBUSY; ++spin) {
+            result = pthread_mutex_trylock(&header->mutex);
+            if (result == EBUSY) {
+                CpuRelax();
+            }
+        }
+        const bool contended = result == EBUSY;
+        if (contended) {
+            result = pthread_mutex_lock(&header->mutex);
+        }
+
+        if (result == EOWNERDEAD) {
+            RollForward();
+            pthread_mutex_consistent(&header->mutex);
+            ++header->recoveriesCount;
+        }
+        else if (result != 0) {
+            throw std::runtime_error("Cannot lock shared memory " + name + ": " + std::strerror(result));
+        }
+        if (contended) {
+            ++header->contendedCount;
+        }
+    }
+
+    // Called with the lock held
+    void Apply(size_t account, int64_t amount) {
+        Journal& journal = header->journal;
+        journal.account = account;
+        journal.balance = balances[account] + amount;
+        journal.deposited = header->deposited + (amount > 0 ? amount : 0);
+        journal.withdrawn = header->withdrawn + (amount < 0 ? -amount : 0);
+        journal.operationsCount = header->operationsCount + 1;
+        std::atomic_ref<uint64_t>(journal.active).store(1, std::memory_order_release);
+
+        Replay(journal);
+        std::atomic_ref<uint64_t>(journal.active).store(0, std::memory_order_release);
+    }
+
+    void RollForward() {
+        Journal& journal = header->journal;
+        if (std::atomic_ref<uint64_t>(journal.active).load(std::memory_order_acquire)) {
+            Replay(journal);
+            std::atomic_ref<uint64_t>(journal.active).store(0, std::memory_order_release);
+        }
+    }
+
+    // Stores absolute values, so replaying an update twice is harmless
+    void Replay(const Journal& journal) {
+        balances[journal.account] = journal.balance;
+        header->deposited = journal.deposited;
+        header->withdrawn = journal.withdrawn;
+        header->operationsCount = journal.operationsCount;
+    }
+
+    std::string name;
+    size_t length = 0;
+    Header* header = nullptr;
+    int64_t* balances = nullptr;
+};
+#endif
@@ -0,0 +1,323 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Ledger.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// One applied operation: amount was added to the account (negative for a
+// withdrawal). Sequences start at 1 and have no gaps, so a record that
+// breaks the run, or fails its checksum, marks the end of the valid log.
+struct LogRecord {
+    uint64_t sequence;
+    uint64_t account;
+    int64_t amount;
+    uint64_t checksum;
+
+    // FNV-1a over the other fields
+    uint64_t ComputeChecksum() const {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        const uint64_t fields[] = { sequence, account, static_cast<uint64_t>(amount) };
+        for (uint64_t field : fields) {
+            for (int i = 0; i < 8; ++i) {
+                hash = (hash ^ (field >> (i * 8) & 0xFF)) * 0x100000001B3ull;
+            }
+        }
+        return hash;
+    }
+};
+
+static_assert(sizeof(LogRecord) == 32, "log records are written as raw 32-byte blocks");
+
+// None leaves the batch in the OS cache once written; Batch also waits for
+// fdatasync (FlushFileBuffers on Windows), so an acknowledged operation
+// survives a power loss.
+enum class SyncPolicy {
+    None,
+    Batch
+};
+
+struct RecoveryResult {
+    uint64_t recordsCount = 0;
+    uint64_t lastSequence = 0;
+    // Torn or corrupt bytes cut from the end of the log
+    uint64_t truncatedBytes = 0;
+};
+
+// Append-only binary log in front of a Ledger, with group commit. Append
+// numbers a record and queues it under a short lock, then blocks until a
+// dedicated flusher has written the batch holding it. The flusher takes
+// whatever accumulated while the previous batch was being written, up to
+// maxBatchRecords, and issues one write and at most one sync for all of it.
+//
+// The ledger itself is changed outside the lock, on its lock-free paths,
+// so that a balance never shows money the log could still lose:
+// - a deposit is logged first and only added once its record is durable;
+// - a withdrawal takes the money at once, as a hold, and is logged after;
+//   if the log cannot be written the hold is paid back.
+// A withdrawal can only have relied on deposits that were already durable,
+// so it always comes later in the log than they do, and replaying any
+// prefix of the log never takes an account below zero.
+//
+// The first batch that cannot be written or synced fails the log for good:
+// that batch and everything queued behind it fail, later Appends throw
+// without queuing, and the file is cut back to the last durable record, so
+// Recover does not replay operations whose callers were told they failed.
+class WriteAheadLog {
+public:
+    WriteAheadLog(const std::string& path, SyncPolicy policy, size_t maxBatchRecords, uint64_t lastSequence = 0)
+        : policy(policy), maxBatchRecords(std::max<size_t>(1, maxBatchRecords)),
+        nextSequence(lastSequence + 1), durableSequence(lastSequence) {
+#ifdef _WIN32
+        // Write access rather than append-only, which SetEndOfFile refuses;
+        // the flusher is the only writer, so it keeps appending at the end
+        file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+            OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size = {};
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size)
+            || !SetFilePointerEx(file, size, nullptr, FILE_BEGIN)) {
+            if (file != INVALID_HANDLE_VALUE) {
+                CloseHandle(file);
+            }
+            throw std::runtime_error("Cannot open log: " + path);
+        }
+        durableBytes = static_cast<uint64_t>(size.QuadPart);
+#else
+        descriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        const off_t size = descriptor < 0 ? -1 : lseek(descriptor, 0, SEEK_END);
+        if (size < 0) {
+            if (descriptor >= 0) {
+                close(descriptor);
+            }
+            throw std::runtime_error("Cannot open log: " + path);
+        }
+        durableBytes = static_cast<uint64_t>(size);
+#endif
+        flusher = std::thread(&WriteAheadLog::FlusherLoop, this);
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Flushes whatever is still queued before closing the file.
+    ~WriteAheadLog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        queued.notify_one();
+        flusher.join();
+#ifdef _WIN32
+        CloseHandle(file);
+#else
+        close(descriptor);
+#endif
+    }
+
+    // Replays every valid record of the log at path into ledger and cuts a
+    // torn tail off the file, so new records follow the last valid one. A
+    // missing log is an empty one. Pass lastSequence on to the constructor.
+    static RecoveryResult Recover(const std::string& path, Ledger& ledger) {
+        RecoveryResult result;
+        std::ifstream file(path, std::ios_base::binary);
+        if (!file) {
+            return result;
+        }
+
+        LogRecord record;
+        while (file.read(reinterpret_cast<char*>(&record), sizeof(record))) {
+            if (record.sequence != result.lastSequence + 1 || record.checksum != record.ComputeChecksum()) {
+                break;
+            }
+            // A valid record the ledger cannot hold is not a torn tail to cut off
+            if (record.account >= ledger.getAccountsCount()) {
+                throw std::runtime_error("Log " + path + " has account " + std::to_string(record.account)
+                    + ", the ledger only " + std::to_string(ledger.getAccountsCount()));
+            }
+            // Amounts are signed, so this also replays withdrawals
+            ledger.Deposit(static_cast<size_t>(record.account), record.amount);
+            result.lastSequence = record.sequence;
+            ++result.recordsCount;
+        }
+        file.close();
+
+        const uint64_t validBytes = result.recordsCount * sizeof(LogRecord);
+        const uint64_t fileBytes = std::filesystem::file_size(path);
+        if (fileBytes > validBytes) {
+            std::filesystem::resize_file(path, validBytes);
+            result.truncatedBytes = fileBytes - validBytes;
+        }
+        return result;
+    }
+
+    // Logs amount for account (negative for a withdrawal) and returns once
+    // the record is written, and synced under SyncPolicy::Batch. Throws if
+    // the record did not make it, or if the log has already failed.
+    void Append(size_t account, int64_t amount) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (failedFrom != NOT_FAILED) {
+            throw std::runtime_error("Cannot write the log");
+        }
+        const uint64_t sequence = nextSequence++;
+        LogRecord record = { sequence, account, amount, 0 };
+        record.checksum = record.ComputeChecksum();
+        pending.push_back(record);
+        queued.notify_one();
+
+        durable.wait(lock, [this, sequence] { return durableSequence >= sequence || failedFrom <= sequence; });
+        if (failedFrom <= sequence) {
+            throw std::runtime_error("Cannot write the log");
+        }
+    }
+
+    // The deposit shows in the ledger only once it is durable. If the log
+    // cannot be written it throws and the ledger is left unchanged.
+    void Deposit(Ledger& ledger, size_t account, int64_t amount, int64_t* balanceAfter = nullptr) {
+        Append(account, amount);
+        const int64_t balance = ledger.Deposit(account, amount);
+        if (balanceAfter) {
+            *balanceAfter = balance;
+        }
+    }
+
+    // Returns false, logging nothing, if the account holds too little. If
+    // the log cannot be written the money is put back before it throws.
+    bool Withdraw(Ledger& ledger, size_t account, int64_t amount, int64_t* balanceAfter = nullptr) {
+        if (!ledger.Withdraw(account, amount, balanceAfter)) {
+            return false;
+        }
+        try {
+            Append(account, -amount);
+        }
+        catch (...) {
+            ledger.Deposit(account, amount);
+            throw;
+        }
+        return true;
+    }
+
+    uint64_t getBatchesCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return batchesCount;
+    }
+
+    uint64_t getRecordsCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return recordsWritten;
+    }
+
+private:
+    void FlusherLoop() {
+        std::vector<LogRecord> batch;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            queued.wait(lock, [this] { return !pending.empty() || stopping; });
+            if (pending.empty()) {
+                return;
+            }
+
+            const size_t count = std::min(pending.size(), maxBatchRecords);
+            batch.assign(pending.begin(), pending.begin() + count);
+            pending.erase(pending.begin(), pending.begin() + count);
+
+            lock.unlock();
+            const bool written = WriteBatch(batch);
+            lock.lock();
+
+            if (!written) {
+                // Nothing after the last durable record counts; Append
+                // queues nothing more, so the flusher is done
+                failedFrom = batch.front().sequence;
+                pending.clear();
+                CutToDurable();
+                durable.notify_all();
+                return;
+            }
+            durableSequence = batch.back().sequence;
+            durableBytes += batch.size() * sizeof(LogRecord);
+            recordsWritten += batch.size();
+            ++batchesCount;
+            durable.notify_all();
+        }
+    }
+
+    // Drops whatever part of a failed batch reached the file. Best effort:
+    // if this fails too, Recover may still replay those records.
+    void CutToDurable() {
+#ifdef _WIN32
+        LARGE_INTEGER size = {};
+        size.QuadPart = static_cast<LONGLONG>(durableBytes);
+        if (SetFilePointerEx(file, size, nullptr, FILE_BEGIN)) {
+            SetEndOfFile(file);
+        }
+#else
+        if (ftruncate(descriptor, static_cast<off_t>(durableBytes)) == 0) {
+            fdatasync(descriptor);
+        }
+#endif
+    }
+
+    bool WriteBatch(const std::vector<LogRecord>& batch) {
+        const size_t bytes = batch.size() * sizeof(LogRecord);
+#ifdef _WIN32
+        DWORD written = 0;
+        if (!WriteFile(file, batch.data(), static_cast<DWORD>(bytes), &written, nullptr) || written != bytes) {
+            return false;
+        }
+        return policy == SyncPolicy::None || FlushFileBuffers(file) != 0;
+#else
+        const char* data = reinterpret_cast<const char*>(batch.data());
+        size_t offset = 0;
+        while (offset < bytes) {
+            const ssize_t written = write(descriptor, data + offset, bytes - offset);
+            if (written < 0) {
+                return false;
+            }
+            offset += static_cast<size_t>(written);
+        }
+        return policy == SyncPolicy::None || fdatasync(descriptor) == 0;
+#endif
+    }
+
+    SyncPolicy policy;
+    size_t maxBatchRecords;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    int descriptor = -1;
+#endif
+
+    static constexpr uint64_t NOT_FAILED = UINT64_MAX;
+
+    mutable std::mutex mutex;
+    std::condition_variable queued;
+    std::condition_variable durable;
+    std::vector<LogRecord> pending;
+    uint64_t nextSequence;
+    uint64_t durableSequence;
+    // Records from this sequence on were not written; NOT_FAILED until then
+    uint64_t failedFrom = NOT_FAILED;
+    // Length of the file up to the last durable record
+    uint64_t durableBytes = 0;
+    uint64_t recordsWritten = 0;
+    uint64_t batchesCount = 0;
+    bool stopping = false;
+    std::thread flusher;
+};
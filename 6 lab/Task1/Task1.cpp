@@ -1,9 +1,14 @@
 ﻿#define _USE_MATH_DEFINES
 
-#include <chrono>
 #include <iostream>
+#include <iomanip>
 #include <cmath>
+#include <string>
+#include <vector>
 #include <omp.h>
+#include "PiKernels.h"
+#include "../../common/Benchmark.h"
+#include "../../common/PerfCounters.h"
 
 double computePiSequential(long long iterations) {
     double pi_approx = 0.0;
@@ -79,42 +84,202 @@ double computePiParallelLocal(long long iterations) {
     return pi_approx * 4.0;
 }
 
+// Per-thread accumulator slots for computePiThreadSlots. The padded slot
+// fills a whole cache line; the unpadded one packs eight threads into one,
+// so every store invalidates the line in the other seven cores.
+struct alignas(64) PaddedSlot {
+    double value = 0.0;
+};
+
+struct UnpaddedSlot {
+    double value = 0.0;
+};
+
+// Each thread adds its terms into its own slot of a shared array, stored to
+// memory on every term (the volatile reference stops the compiler from
+// keeping the sum in a register, which would hide the layout). The slots
+// are then combined by a tree: in round r, thread t adds slot t + 2^r into
+// slot t when t is a multiple of 2^(r+1), so p slots need log2(p) rounds.
+template<typename Slot>
+double computePiThreadSlots(long long iterations) {
+    std::vector<Slot> slots(omp_get_max_threads());
+
+#pragma omp parallel
+    {
+        int thread = omp_get_thread_num();
+        int threads = omp_get_num_threads();
+        volatile double& accumulator = slots[thread].value;
+
+#pragma omp for
+        for (long long k = 0; k < iterations; ++k) {
+            double denominator = 2.0 * k + 1.0;
+            double term = (k % 2 == 0) ? 1.0 / denominator : -1.0 / denominator;
+            accumulator = accumulator + term;
+        }
+
+        for (int stride = 1; stride < threads; stride *= 2) {
+            if (thread % (2 * stride) == 0 && thread + stride < threads) {
+                slots[thread].value += slots[thread + stride].value;
+            }
+#pragma omp barrier
+        }
+    }
+
+    return slots[0].value * 4.0;
+}
+
+// Paired terms through the fastest kernel the CPU has, split across threads.
+double computePiSimd(long long iterations) {
+    const PairKernel kernel = selectPairKernel();
+    const long long pairs = iterations / 2;
+    double sum = 0.0;
+
+#pragma omp parallel reduction(+:sum)
+    {
+        int threads = omp_get_num_threads();
+        int thread = omp_get_thread_num();
+        long long first_pair = pairs * thread / threads;
+        long long last_pair = pairs * (thread + 1) / threads;
+        sum += kernel(first_pair, last_pair);
+    }
+
+    // An odd count leaves one unpaired term, 2k + 1 with k even, so positive
+    double tail = iterations % 2 ? 1.0 / (2.0 * (iterations - 1) + 1.0) : 0.0;
+    return 8.0 * sum + 4.0 * tail;
+}
+
+// Every pair added with Neumaier compensation, per thread; the per-thread
+// sums are then combined in thread order, also compensated. The slow but
+// most accurate reference.
+double computePiKahan(long long iterations) {
+    const long long pairs = iterations / 2;
+    std::vector<CompensatedSum> partial_sums(omp_get_max_threads());
+
+#pragma omp parallel
+    {
+        CompensatedSum local_sum;
+
+#pragma omp for schedule(static)
+        for (long long j = 0; j < pairs; ++j) {
+            double a = 4.0 * j + 1.0;
+            local_sum.add(1.0 / (a * (a + 2.0)));
+        }
+
+        partial_sums[omp_get_thread_num()] = local_sum;
+    }
+
+    CompensatedSum sum;
+    for (const CompensatedSum& partial : partial_sums) {
+        sum.add(partial.sum);
+        sum.add(partial.compensation);
+    }
+
+    double tail = iterations % 2 ? 1.0 / (2.0 * (iterations - 1) + 1.0) : 0.0;
+    return 8.0 * sum.total() + 4.0 * tail;
+}
+
+// Fixed-size blocks summed by the SIMD kernel, then the block sums added
+// pairwise. Nearly as fast as computePiSimd, with rounding error growing
+// with log(n) instead of n, and the same result for any number of threads.
+double computePiSimdPairwise(long long iterations) {
+    const long long PAIRS_PER_BLOCK = 1 << 16;
+    const PairKernel kernel = selectPairKernel();
+    const long long pairs = iterations / 2;
+    const long long blocks = (pairs + PAIRS_PER_BLOCK - 1) / PAIRS_PER_BLOCK;
+    std::vector<double> block_sums(blocks);
+
+#pragma omp parallel for schedule(static)
+    for (long long block = 0; block < blocks; ++block) {
+        long long first_pair = block * PAIRS_PER_BLOCK;
+        block_sums[block] = kernel(first_pair, std::min(first_pair + PAIRS_PER_BLOCK, pairs));
+    }
+
+    double tail = iterations % 2 ? 1.0 / (2.0 * (iterations - 1) + 1.0) : 0.0;
+    return 8.0 * pairwiseSum(block_sums.data(), block_sums.size()) + 4.0 * tail;
+}
+
+// Results are printed in full. The error against pi is dominated by the
+// series itself (about 1/iterations), the same for every method, so the
+// difference from the compensated sum, reference, is printed as well: that
+// one is rounding alone. With count_events set, one more run is made with
+// every thread's hardware counters on; the timed runs are left
+// uninstrumented.
 template<typename Func>
-double benchmark(Func&& computation, const std::string& label) {
-    auto start_time = std::chrono::high_resolution_clock::now();
+double benchmark(Benchmark& harness, Func&& computation, const std::string& label, long long iterations,
+    double reference, bool count_events) {
     double result = computation();
-    auto end_time = std::chrono::high_resolution_clock::now();
+    BenchmarkResult timing = harness.Run(label, computation);
 
-    std::chrono::duration<double> elapsed = end_time - start_time;
+    std::cout << label << ": " << std::setprecision(17) << result << std::setprecision(6)
+        << " (time: " << timing.median << " s median, MAD " << timing.mad << " s, "
+        << iterations / timing.median << " terms/s, error: " << std::scientific << std::setprecision(3)
+        << std::abs(result - M_PI) << ", vs Kahan: " << result - reference
+        << std::defaultfloat << std::setprecision(6) << ")" << std::endl;
 
-    std::cout << label << ": " << result
-        << " (time: " << elapsed.count() << " s)" << std::endl;
+    if (count_events) {
+        MeasureOpenMp(computation).Print(std::cout, "Counters");
+        std::cout << std::endl;
+    }
 
     return result;
 }
 
-int main() {
-    const long long num_iterations = 10000000;
+// Usage: Task1 [iterations] [--perf] [--samples=N] [--warmups=N] [--min-time=s] [--pin=core] [--json=path] [--csv=path]
+int main(int argc, char** argv) {
+    long long num_iterations = 10000000;
+    bool count_events = false;
+    BenchmarkOptions options;
+    options.samplesCount = 5;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--perf") {
+            count_events = true;
+        }
+        else if (!options.ParseFlag(arg)) {
+            num_iterations = std::stoll(arg);
+        }
+    }
+
+    Benchmark harness(options);
+    const double kahan_pi = computePiKahan(num_iterations);
 
     std::cout << "Comparison of PI calculation methods ("
         << num_iterations << " iterations):\n" << std::endl;
 
-    benchmark([&]() { return computePiSequential(num_iterations); },
-        "Sequential method");
+    benchmark(harness, [&]() { return computePiSequential(num_iterations); },
+        "Sequential method", num_iterations, kahan_pi, count_events);
+
+    benchmark(harness, [&]() { return computePiParallelRace(num_iterations); },
+        "Parallel (with data race)", num_iterations, kahan_pi, count_events);
+
+    benchmark(harness, [&]() { return computePiParallelAtomic(num_iterations); },
+        "Parallel (atomic)", num_iterations, kahan_pi, count_events);
+
+    benchmark(harness, [&]() { return computePiParallelReduction(num_iterations); },
+        "Parallel (reduction)", num_iterations, kahan_pi, count_events);
+
+    benchmark(harness, [&]() { return computePiParallelLocal(num_iterations); },
+        "Parallel (local sums)", num_iterations, kahan_pi, count_events);
+
+    benchmark(harness, [&]() { return computePiThreadSlots<PaddedSlot>(num_iterations); },
+        "Parallel (padded per-thread slots, tree reduction)", num_iterations, kahan_pi, count_events);
+
+    benchmark(harness, [&]() { return computePiThreadSlots<UnpaddedSlot>(num_iterations); },
+        "Parallel (unpadded per-thread slots, false sharing)", num_iterations, kahan_pi, count_events);
 
-    benchmark([&]() { return computePiParallelRace(num_iterations); },
-        "Parallel (with data race)");
+    benchmark(harness, [&]() { return computePiSimd(num_iterations); },
+        std::string("Parallel SIMD pairs (") + pairKernelName(selectPairKernel()) + ")", num_iterations, kahan_pi, count_events);
 
-    benchmark([&]() { return computePiParallelAtomic(num_iterations); },
-        "Parallel (atomic)");
+    benchmark(harness, [&]() { return computePiKahan(num_iterations); },
+        "Parallel Kahan (compensated)", num_iterations, kahan_pi, count_events);
 
-    benchmark([&]() { return computePiParallelReduction(num_iterations); },
-        "Parallel (reduction)");
+    benchmark(harness, [&]() { return computePiSimdPairwise(num_iterations); },
+        "Parallel SIMD pairs, pairwise blocks", num_iterations, kahan_pi, count_events);
 
-    benchmark([&]() { return computePiParallelLocal(num_iterations); },
-        "Parallel (local sums)");
+    std::cout << "\nExact PI value: " << std::setprecision(17) << M_PI << std::endl;
 
-    std::cout << "\nExact PI value: " << M_PI << std::endl;
+    harness.WriteReports();
 
     return 0;
 }
@@ -1,5 +1,5 @@
-#include <format>
 #include <iostream>
+#include <sstream>
 #include <omp.h>
 
 int main() {
@@ -9,8 +9,11 @@ int main() {
     // #pragma omp parallel for lastprivate(x)
     for (int i = 0; i <= 10; i++) {
         x = i;
-        std::cout << std::format("Thread number: {}\tx: {}\n", omp_get_thread_num(), x);
+        // One write per line, so lines from different threads do not interleave
+        std::ostringstream line;
+        line << "Thread number: " << omp_get_thread_num() << "\tx: " << x << "\n";
+        std::cout << line.str();
     }
-    std::cout << std::format("x is {}\n", x) << std::flush;
+    std::cout << "x is " << x << "\n" << std::flush;
     return 0;
 }
\ No newline at end of file
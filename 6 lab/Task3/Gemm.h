@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include "Matrix.h"
+#include "MicroKernels.h"
+
+// Cache-blocked C = A * B. C is cut into MC x NC tiles that OpenMP hands out
+// to threads; each tile walks k in KC-deep slices. For a slice the thread
+// packs its MC x KC block of A (sized for L2) and the KC x NC panel of B
+// into contiguous micro-panels, then sweeps an MR x NR register-blocked
+// micro-kernel over them: the KC x NR sliver of B stays in L1 while the
+// slivers of A stream from L2, and every packed element is read with unit
+// stride. Partial edge panels are padded with zeros when packed, so the
+// micro-kernel never has to check bounds.
+namespace gemm {
+
+constexpr int MC = 128;
+constexpr int KC = 256;
+constexpr int NC = 512;
+
+// MR-row micro-panels of A(ic.., pc..), each stored k-major: panel[k * MR + r].
+inline void packA(MatrixView<const int> A, int ic, int pc, int mc, int kc, int* packed) {
+    for (int ir = 0; ir < mc; ir += MR) {
+        for (int k = 0; k < kc; ++k) {
+            for (int r = 0; r < MR; ++r) {
+                *packed++ = ir + r < mc ? A(ic + ir + r, pc + k) : 0;
+            }
+        }
+    }
+}
+
+// NR-column micro-panels of B(pc.., jc..), each stored k-major: panel[k * NR + c].
+inline void packB(MatrixView<const int> B, int pc, int jc, int kc, int nc, int* packed) {
+    for (int jr = 0; jr < nc; jr += NR) {
+        const int nr = std::min(NR, nc - jr);
+        for (int k = 0; k < kc; ++k) {
+            const int* source = B.row(pc + k) + jc + jr;
+            for (int c = 0; c < NR; ++c) {
+                *packed++ = c < nr ? source[c] : 0;
+            }
+        }
+    }
+}
+
+// Pack buffers are kept per thread for its lifetime, so neither the
+// parallel multiply nor the recursive one allocates them per call.
+struct PackBuffers {
+    AlignedBuffer<int> a = allocateAligned<int>(static_cast<size_t>(MC) * KC);
+    AlignedBuffer<int> b = allocateAligned<int>(static_cast<size_t>(KC) * NC);
+
+    static PackBuffers& forCurrentThread() {
+        thread_local PackBuffers buffers;
+        return buffers;
+    }
+};
+
+// Stores the product of the rows [ic, ic + mc) of A and the columns
+// [jc, jc + nc) of B into the same tile of C.
+template <typename Acc>
+void multiplyTile(MatrixView<const int> A, MatrixView<const int> B, MatrixView<Acc> C,
+    int ic, int jc, MicroKernel<Acc> microKernel) {
+    const int n = static_cast<int>(A.n);
+    const int mc = std::min(MC, n - ic);
+    const int nc = std::min(NC, n - jc);
+    PackBuffers& buffers = PackBuffers::forCurrentThread();
+
+    for (int pc = 0; pc < n; pc += KC) {
+        const int kc = std::min(KC, n - pc);
+        packB(B, pc, jc, kc, nc, buffers.b.get());
+        packA(A, ic, pc, mc, kc, buffers.a.get());
+
+        for (int jr = 0; jr < nc; jr += NR) {
+            for (int ir = 0; ir < mc; ir += MR) {
+                microKernel(kc, buffers.a.get() + ir * kc, buffers.b.get() + jr * kc,
+                    C.row(ic + ir) + jc + jr, C.stride,
+                    std::min(MR, mc - ir), std::min(NR, nc - jr), pc > 0);
+            }
+        }
+    }
+}
+
+// Single-threaded C = A * B on views, for callers that parallelise above it.
+template <typename Acc>
+void multiplyBlockedSerial(MatrixView<const int> A, MatrixView<const int> B, MatrixView<Acc> C,
+    MicroKernel<Acc> microKernel) {
+    const int n = static_cast<int>(A.n);
+    for (int ic = 0; ic < n; ic += MC) {
+        for (int jc = 0; jc < n; jc += NC) {
+            multiplyTile(A, B, C, ic, jc, microKernel);
+        }
+    }
+}
+
+// Acc = int64_t gives the overflow-safe product; see MicroKernels.h.
+template <typename Acc = int>
+BasicMatrix<Acc> multiplyBlocked(const Matrix& A, const Matrix& B, Isa isa = Isa::Auto) {
+    const int n = static_cast<int>(A.getSize());
+    const MicroKernel<Acc> microKernel = selectMicroKernel<Acc>(isa);
+    BasicMatrix<Acc> C(n);
+
+    const int rowTiles = (n + MC - 1) / MC;
+    const int columnTiles = (n + NC - 1) / NC;
+
+    // One flat loop rather than collapse(2), which MSVC's OpenMP 2.0 lacks
+#pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < rowTiles * columnTiles; ++tile) {
+        multiplyTile(A.view(), B.view(), C.view(), tile / columnTiles * MC, tile % columnTiles * NC, microKernel);
+    }
+
+    return C;
+}
+
+}
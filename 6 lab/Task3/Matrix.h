@@ -0,0 +1,152 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+
+constexpr size_t MATRIX_ALIGNMENT = 64;
+
+template <typename T>
+struct AlignedDeleter {
+    void operator()(T* memory) const {
+        ::operator delete[](memory, std::align_val_t(MATRIX_ALIGNMENT));
+    }
+};
+
+template <typename T>
+using AlignedBuffer = std::unique_ptr<T[], AlignedDeleter<T>>;
+
+// Uninitialised, so the thread that first writes a page also places it.
+template <typename T>
+AlignedBuffer<T> allocateAligned(size_t count) {
+    return AlignedBuffer<T>(count == 0 ? nullptr : static_cast<T*>(
+        ::operator new[](count * sizeof(T), std::align_val_t(MATRIX_ALIGNMENT))));
+}
+
+// Square n x n window into a matrix (the whole matrix or one of its blocks).
+// Does not own the elements.
+template <typename T>
+struct MatrixView {
+    T* data;
+    unsigned n;
+    unsigned stride;
+
+    T* row(unsigned i) const {
+        return data + static_cast<size_t>(i) * stride;
+    }
+
+    T& operator()(unsigned i, unsigned j) const {
+        return row(i)[j];
+    }
+
+    // Quadrant (qi, qj) of an even-sized view.
+    MatrixView quadrant(unsigned qi, unsigned qj) const {
+        const unsigned half = n / 2;
+        return { row(qi * half) + qj * half, half, stride };
+    }
+};
+
+template <typename T>
+MatrixView<const T> asConst(MatrixView<T> view) {
+    return { view.data, view.n, view.stride };
+}
+
+// Square n x n matrix in one contiguous row-major block. Every row starts on
+// a 64-byte boundary (the stride is n rounded up to a whole cache line), so
+// a row never shares a cache line with the next one and vector loads along
+// a row can be aligned.
+template <typename T>
+class BasicMatrix {
+public:
+    static constexpr unsigned ELEMENTS_PER_LINE = MATRIX_ALIGNMENT / sizeof(T);
+
+    BasicMatrix() = default;
+
+    // Elements are left uninitialised; call fill when zeros are needed.
+    explicit BasicMatrix(unsigned n)
+        : n(n),
+        stride((n + ELEMENTS_PER_LINE - 1) / ELEMENTS_PER_LINE * ELEMENTS_PER_LINE),
+        elements(allocateAligned<T>(static_cast<size_t>(stride) * n)) {
+    }
+
+    BasicMatrix(const BasicMatrix& other)
+        : BasicMatrix(other.n) {
+        if (elements) {
+            memcpy(elements.get(), other.elements.get(), sizeof(T) * stride * n);
+        }
+    }
+
+    BasicMatrix& operator=(const BasicMatrix& other) {
+        if (this != &other) {
+            *this = BasicMatrix(other);
+        }
+        return *this;
+    }
+
+    BasicMatrix(BasicMatrix&&) noexcept = default;
+    BasicMatrix& operator=(BasicMatrix&&) noexcept = default;
+
+    unsigned getSize() const {
+        return n;
+    }
+
+    // Elements between row starts, a multiple of ELEMENTS_PER_LINE.
+    unsigned getStride() const {
+        return stride;
+    }
+
+    T* row(unsigned i) {
+        return elements.get() + static_cast<size_t>(i) * stride;
+    }
+
+    const T* row(unsigned i) const {
+        return elements.get() + static_cast<size_t>(i) * stride;
+    }
+
+    T& operator()(unsigned i, unsigned j) {
+        return row(i)[j];
+    }
+
+    T operator()(unsigned i, unsigned j) const {
+        return row(i)[j];
+    }
+
+    MatrixView<T> view() {
+        return { elements.get(), n, stride };
+    }
+
+    MatrixView<const T> view() const {
+        return { elements.get(), n, stride };
+    }
+
+    void fill(T value) {
+        for (unsigned i = 0; i < n; ++i) {
+            std::fill(row(i), row(i) + n, value);
+        }
+    }
+
+    // Element-wise comparison, also across element types.
+    template <typename U>
+    bool operator==(const BasicMatrix<U>& other) const {
+        if (n != other.getSize()) {
+            return false;
+        }
+        for (unsigned i = 0; i < n; ++i) {
+            if (!std::equal(row(i), row(i) + n, other.row(i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    unsigned n = 0;
+    unsigned stride = 0;
+    AlignedBuffer<T> elements;
+};
+
+using Matrix = BasicMatrix<int>;
+// Wide results for the int64 accumulator mode.
+using Matrix64 = BasicMatrix<int64_t>;
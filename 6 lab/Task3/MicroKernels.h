@@ -0,0 +1,198 @@
+#pragma once
+#include <cstdint>
+#include <type_traits>
+#include "../../common/CpuFeatures.h"
+
+// Register-blocked MR x NR micro-kernels for the blocked multiply. They read
+// an MR-row sliver of packed A (a[k * MR + r]) and an NR-column sliver of
+// packed B (b[k * NR + c]), both 64-byte aligned, and add or store the
+// product into C. Acc is the accumulator and result type: int keeps the
+// plain int32 product, int64_t widens every product so no sum can wrap.
+namespace gemm {
+
+constexpr int MR = 4;
+constexpr int NR = 16;
+
+enum class Isa {
+    Auto,
+    Scalar,
+    Sse41,
+    Avx2
+};
+
+template <typename Acc>
+using MicroKernel = void (*)(int kc, const int* a, const int* b, Acc* c, unsigned ldc, int mr, int nr, bool accumulate);
+
+// Writes the mr x nr corner of a finished tile into C.
+template <typename Acc>
+inline void writeBack(const Acc (&tile)[MR][NR], Acc* c, unsigned ldc, int mr, int nr, bool accumulate) {
+    for (int r = 0; r < mr; ++r) {
+        Acc* target = c + static_cast<size_t>(r) * ldc;
+        for (int col = 0; col < nr; ++col) {
+            target[col] = accumulate ? target[col] + tile[r][col] : tile[r][col];
+        }
+    }
+}
+
+template <typename Acc>
+inline void microKernelScalar(int kc, const int* a, const int* b, Acc* c, unsigned ldc, int mr, int nr, bool accumulate) {
+    Acc tile[MR][NR] = {};
+    for (int k = 0; k < kc; ++k) {
+        for (int r = 0; r < MR; ++r) {
+            const Acc value = a[k * MR + r];
+            for (int col = 0; col < NR; ++col) {
+                tile[r][col] += value * b[k * NR + col];
+            }
+        }
+    }
+    writeBack(tile, c, ldc, mr, nr, accumulate);
+}
+
+#if CPU_FEATURES_X86
+
+// pmulld, the 32-bit low multiply, is the first SSE instruction that needs SSE4.1.
+TARGET_SSE41 inline void microKernelSse41(int kc, const int* a, const int* b, int* c, unsigned ldc,
+    int mr, int nr, bool accumulate) {
+    __m128i acc[MR][NR / 4] = {};
+    for (int k = 0; k < kc; ++k) {
+        __m128i row[NR / 4];
+        for (int v = 0; v < NR / 4; ++v) {
+            row[v] = _mm_load_si128(reinterpret_cast<const __m128i*>(b + k * NR) + v);
+        }
+        for (int r = 0; r < MR; ++r) {
+            const __m128i value = _mm_set1_epi32(a[k * MR + r]);
+            for (int v = 0; v < NR / 4; ++v) {
+                acc[r][v] = _mm_add_epi32(acc[r][v], _mm_mullo_epi32(value, row[v]));
+            }
+        }
+    }
+
+    alignas(64) int tile[MR][NR];
+    for (int r = 0; r < MR; ++r) {
+        for (int v = 0; v < NR / 4; ++v) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(tile[r]) + v, acc[r][v]);
+        }
+    }
+    writeBack(tile, c, ldc, mr, nr, accumulate);
+}
+
+// pmuldq multiplies the sign-extended low halves of 64-bit lanes, so B is
+// widened once per k and every product is exact.
+TARGET_SSE41 inline void microKernelSse41Wide(int kc, const int* a, const int* b, int64_t* c, unsigned ldc,
+    int mr, int nr, bool accumulate) {
+    __m128i acc[MR][NR / 2] = {};
+    for (int k = 0; k < kc; ++k) {
+        __m128i row[NR / 2];
+        for (int v = 0; v < NR / 2; ++v) {
+            row[v] = _mm_cvtepi32_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + k * NR + 2 * v)));
+        }
+        for (int r = 0; r < MR; ++r) {
+            const __m128i value = _mm_set1_epi64x(a[k * MR + r]);
+            for (int v = 0; v < NR / 2; ++v) {
+                acc[r][v] = _mm_add_epi64(acc[r][v], _mm_mul_epi32(value, row[v]));
+            }
+        }
+    }
+
+    alignas(64) int64_t tile[MR][NR];
+    for (int r = 0; r < MR; ++r) {
+        for (int v = 0; v < NR / 2; ++v) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(tile[r]) + v, acc[r][v]);
+        }
+    }
+    writeBack(tile, c, ldc, mr, nr, accumulate);
+}
+
+// 4 x 16 int32 accumulators fill 8 of the 16 ymm registers, leaving room
+// for the two B vectors and the broadcast A value.
+TARGET_AVX2 inline void microKernelAvx2(int kc, const int* a, const int* b, int* c, unsigned ldc,
+    int mr, int nr, bool accumulate) {
+    __m256i acc[MR][NR / 8] = {};
+    for (int k = 0; k < kc; ++k) {
+        const __m256i row0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(b + k * NR));
+        const __m256i row1 = _mm256_load_si256(reinterpret_cast<const __m256i*>(b + k * NR + 8));
+        for (int r = 0; r < MR; ++r) {
+            const __m256i value = _mm256_set1_epi32(a[k * MR + r]);
+            acc[r][0] = _mm256_add_epi32(acc[r][0], _mm256_mullo_epi32(value, row0));
+            acc[r][1] = _mm256_add_epi32(acc[r][1], _mm256_mullo_epi32(value, row1));
+        }
+    }
+
+    alignas(64) int tile[MR][NR];
+    for (int r = 0; r < MR; ++r) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(tile[r]), acc[r][0]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(tile[r]) + 1, acc[r][1]);
+    }
+    writeBack(tile, c, ldc, mr, nr, accumulate);
+}
+
+TARGET_AVX2 inline void microKernelAvx2Wide(int kc, const int* a, const int* b, int64_t* c, unsigned ldc,
+    int mr, int nr, bool accumulate) {
+    __m256i acc[MR][NR / 4] = {};
+    for (int k = 0; k < kc; ++k) {
+        __m256i row[NR / 4];
+        for (int v = 0; v < NR / 4; ++v) {
+            row[v] = _mm256_cvtepi32_epi64(_mm_load_si128(reinterpret_cast<const __m128i*>(b + k * NR) + v));
+        }
+        for (int r = 0; r < MR; ++r) {
+            const __m256i value = _mm256_set1_epi64x(a[k * MR + r]);
+            for (int v = 0; v < NR / 4; ++v) {
+                acc[r][v] = _mm256_add_epi64(acc[r][v], _mm256_mul_epi32(value, row[v]));
+            }
+        }
+    }
+
+    alignas(64) int64_t tile[MR][NR];
+    for (int r = 0; r < MR; ++r) {
+        for (int v = 0; v < NR / 4; ++v) {
+            _mm256_store_si256(reinterpret_cast<__m256i*>(tile[r]) + v, acc[r][v]);
+        }
+    }
+    writeBack(tile, c, ldc, mr, nr, accumulate);
+}
+
+#endif
+
+// Auto becomes the widest ISA the CPU has; an explicit request the CPU
+// cannot run falls back to the next narrower one.
+inline Isa resolveIsa(Isa isa) {
+#if CPU_FEATURES_X86
+    const CpuFeatures& features = CpuFeatures::Get();
+    if ((isa == Isa::Auto || isa == Isa::Avx2) && features.avx2) {
+        return Isa::Avx2;
+    }
+    if (isa != Isa::Scalar && features.sse41) {
+        return Isa::Sse41;
+    }
+#endif
+    return Isa::Scalar;
+}
+
+template <typename Acc>
+MicroKernel<Acc> selectMicroKernel(Isa isa) {
+    static_assert(std::is_same_v<Acc, int> || std::is_same_v<Acc, int64_t>, "int or int64_t accumulators");
+#if CPU_FEATURES_X86
+    switch (resolveIsa(isa)) {
+    case Isa::Avx2:
+        if constexpr (std::is_same_v<Acc, int>) return microKernelAvx2;
+        else return microKernelAvx2Wide;
+    case Isa::Sse41:
+        if constexpr (std::is_same_v<Acc, int>) return microKernelSse41;
+        else return microKernelSse41Wide;
+    default:
+        break;
+    }
+#endif
+    return microKernelScalar<Acc>;
+}
+
+inline const char* isaName(Isa isa) {
+    switch (isa) {
+    case Isa::Avx2: return "avx2";
+    case Isa::Sse41: return "sse4.1";
+    case Isa::Scalar: return "scalar";
+    default: return "auto";
+    }
+}
+
+}
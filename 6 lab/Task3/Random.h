@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include "Matrix.h"
+
+// Counter-based generation: element (i, j) is a pure function of the seed
+// and its index, so rows can be filled by any number of threads in any
+// order and still give the same matrix for the same seed.
+
+// SplitMix64 finaliser; a full-avalanche mix of one 64-bit word.
+inline uint64_t splitMix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Uniform in [low, high] by multiply-shift, without the division of %.
+inline int uniformInt(uint64_t bits, int low, int high) {
+    const uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(high) - low + 1);
+    return static_cast<int>(low + static_cast<int64_t>(((bits >> 32) * range) >> 32));
+}
+
+inline Matrix createRandomMatrix(unsigned n, int low, int high, uint64_t seed) {
+    Matrix m(n);
+    const uint64_t stream = splitMix64(seed);
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < (int)n; ++i) {
+        int* row = m.row(i);
+        for (unsigned j = 0; j < n; ++j) {
+            row[j] = uniformInt(splitMix64(stream + static_cast<uint64_t>(i) * n + j), low, high);
+        }
+    }
+
+    return m;
+}
@@ -0,0 +1,213 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include "Gemm.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// OpenMP tasks arrived in 3.0; MSVC's default /openmp is 2.0, /openmp:llvm has them.
+#if defined(_OPENMP) && _OPENMP >= 200805
+#define STRASSEN_TASKS 1
+#else
+#define STRASSEN_TASKS 0
+#endif
+
+// Strassen-Winograd multiply: 7 half-size products and 15 additions per
+// level instead of 8 products. Sizes above the cutoff recurse; at or below
+// it the blocked kernel takes over. The top taskDepth levels run their 7
+// products as OpenMP tasks, each in its own slice of the workspace; deeper
+// levels run them one after another and share a slice. The whole workspace
+// is one allocation sized up front, so recursion never allocates.
+namespace gemm {
+
+struct StrassenOptions {
+    unsigned cutoff = 512;
+    // Levels whose products run as tasks; negative picks enough for all threads.
+    int taskDepth = -1;
+    Isa isa = Isa::Auto;
+};
+
+// S1-S4, T1-T4 and the three products that have no quadrant of C to live in.
+constexpr int STRASSEN_TEMPORARIES = 11;
+
+inline unsigned alignedStride(unsigned n) {
+    return (n + Matrix::ELEMENTS_PER_LINE - 1) / Matrix::ELEMENTS_PER_LINE * Matrix::ELEMENTS_PER_LINE;
+}
+
+// Elements a node of size n needs for itself and its whole subtree.
+inline size_t strassenWorkspace(unsigned n, unsigned cutoff, int depth, int taskDepth) {
+    if (n <= cutoff) {
+        return 0;
+    }
+
+    const unsigned half = n / 2;
+    const size_t child = strassenWorkspace(half, cutoff, depth + 1, taskDepth);
+    return STRASSEN_TEMPORARIES * static_cast<size_t>(half) * alignedStride(half) + (depth < taskDepth ? 7 : 1) * child;
+}
+
+inline void addMatrices(MatrixView<const int> X, MatrixView<const int> Y, MatrixView<int> Z) {
+    for (unsigned i = 0; i < Z.n; ++i) {
+        const int* x = X.row(i);
+        const int* y = Y.row(i);
+        int* z = Z.row(i);
+        for (unsigned j = 0; j < Z.n; ++j) {
+            z[j] = x[j] + y[j];
+        }
+    }
+}
+
+inline void subtractMatrices(MatrixView<const int> X, MatrixView<const int> Y, MatrixView<int> Z) {
+    for (unsigned i = 0; i < Z.n; ++i) {
+        const int* x = X.row(i);
+        const int* y = Y.row(i);
+        int* z = Z.row(i);
+        for (unsigned j = 0; j < Z.n; ++j) {
+            z[j] = x[j] - y[j];
+        }
+    }
+}
+
+struct StrassenPlan {
+    unsigned cutoff;
+    int taskDepth;
+    MicroKernel<int> microKernel;
+};
+
+inline void strassenMultiply(MatrixView<const int> A, MatrixView<const int> B, MatrixView<int> C,
+    int* workspace, const StrassenPlan& plan, int depth) {
+    if (A.n <= plan.cutoff) {
+        multiplyBlockedSerial(A, B, C, plan.microKernel);
+        return;
+    }
+
+    const unsigned half = A.n / 2;
+    const unsigned stride = alignedStride(half);
+    const size_t quadrantElements = static_cast<size_t>(half) * stride;
+    auto temporary = [&](int index) {
+        return MatrixView<int>{ workspace + index * quadrantElements, half, stride };
+    };
+
+    const auto A11 = A.quadrant(0, 0), A12 = A.quadrant(0, 1), A21 = A.quadrant(1, 0), A22 = A.quadrant(1, 1);
+    const auto B11 = B.quadrant(0, 0), B12 = B.quadrant(0, 1), B21 = B.quadrant(1, 0), B22 = B.quadrant(1, 1);
+    const auto C11 = C.quadrant(0, 0), C12 = C.quadrant(0, 1), C21 = C.quadrant(1, 0), C22 = C.quadrant(1, 1);
+    const auto S1 = temporary(0), S2 = temporary(1), S3 = temporary(2), S4 = temporary(3);
+    const auto T1 = temporary(4), T2 = temporary(5), T3 = temporary(6), T4 = temporary(7);
+    const auto P1 = temporary(8), P4 = temporary(9), P6 = temporary(10);
+
+    addMatrices(A21, A22, S1);
+    subtractMatrices(asConst(S1), A11, S2);
+    subtractMatrices(A11, A21, S3);
+    subtractMatrices(A12, asConst(S2), S4);
+    subtractMatrices(B12, B11, T1);
+    subtractMatrices(B22, asConst(T1), T2);
+    subtractMatrices(B22, B12, T3);
+    subtractMatrices(asConst(T2), B21, T4);
+
+    // P2, P3, P5 and P7 go straight into the quadrant of C they first contribute to
+    struct Product {
+        MatrixView<const int> left;
+        MatrixView<const int> right;
+        MatrixView<int> result;
+    };
+    const Product products[7] = {
+        { A11, B11, P1 },
+        { A12, B21, C11 },
+        { asConst(S4), B22, C12 },
+        { A22, asConst(T4), P4 },
+        { asConst(S1), asConst(T1), C22 },
+        { asConst(S2), asConst(T2), P6 },
+        { asConst(S3), asConst(T3), C21 }
+    };
+
+    const bool parallel = depth < plan.taskDepth;
+    int* childWorkspace = workspace + STRASSEN_TEMPORARIES * quadrantElements;
+    const size_t childElements = strassenWorkspace(half, plan.cutoff, depth + 1, plan.taskDepth);
+
+    for (int i = 0; i < 7; ++i) {
+#if STRASSEN_TASKS
+#pragma omp task if(parallel)
+#endif
+        strassenMultiply(products[i].left, products[i].right, products[i].result,
+            childWorkspace + (parallel ? i * childElements : 0), plan, depth + 1);
+    }
+#if STRASSEN_TASKS
+#pragma omp taskwait
+#endif
+
+    // The order matters: C22 still holds P5 when U4 is formed, and C21 must
+    // hold U3 when it is added into C22.
+    addMatrices(asConst(C11), asConst(P1), C11);  // C11 = P1 + P2
+    addMatrices(asConst(P6), asConst(P1), P6);    // U2 = P1 + P6
+    addMatrices(asConst(C21), asConst(P6), C21);  // U3 = U2 + P7
+    addMatrices(asConst(P6), asConst(C22), P6);   // U4 = U2 + P5
+    addMatrices(asConst(C12), asConst(P6), C12);  // C12 = U4 + P3
+    addMatrices(asConst(C22), asConst(C21), C22); // C22 = U3 + P5
+    subtractMatrices(asConst(C21), asConst(P4), C21); // C21 = U3 - P4
+}
+
+// Copy of M in the top-left corner of a size x size matrix of zeros.
+inline Matrix padMatrix(const Matrix& M, unsigned size) {
+    Matrix padded(size);
+    padded.fill(0);
+    for (unsigned i = 0; i < M.getSize(); ++i) {
+        std::copy(M.row(i), M.row(i) + M.getSize(), padded.row(i));
+    }
+    return padded;
+}
+
+inline Matrix multiplyStrassen(const Matrix& A, const Matrix& B, const StrassenOptions& options = StrassenOptions()) {
+    const unsigned n = A.getSize();
+    const unsigned cutoff = std::max(options.cutoff, 1u);
+
+    // Halve until the leaves fit under the cutoff, then pad so every level is even
+    unsigned leafSize = n;
+    int levels = 0;
+    while (leafSize > cutoff) {
+        leafSize = (leafSize + 1) / 2;
+        levels++;
+    }
+    const unsigned paddedSize = leafSize << levels;
+
+    int taskDepth = options.taskDepth;
+    if (taskDepth < 0) {
+        int threads = 1;
+#ifdef _OPENMP
+        threads = omp_get_max_threads();
+#endif
+        taskDepth = 0;
+        for (int tasks = 1; tasks < threads && taskDepth < 2; tasks *= 7) {
+            taskDepth++;
+        }
+    }
+    if (!STRASSEN_TASKS) {
+        taskDepth = 0;
+    }
+
+    const StrassenPlan plan{ cutoff, taskDepth, selectMicroKernel<int>(options.isa) };
+    AlignedBuffer<int> workspace = allocateAligned<int>(strassenWorkspace(paddedSize, cutoff, 0, taskDepth));
+
+    if (paddedSize == n) {
+        Matrix C(n);
+#pragma omp parallel
+#pragma omp single
+        strassenMultiply(A.view(), B.view(), C.view(), workspace.get(), plan, 0);
+        return C;
+    }
+
+    const Matrix paddedA = padMatrix(A, paddedSize);
+    const Matrix paddedB = padMatrix(B, paddedSize);
+    Matrix paddedC(paddedSize);
+#pragma omp parallel
+#pragma omp single
+    strassenMultiply(paddedA.view(), paddedB.view(), paddedC.view(), workspace.get(), plan, 0);
+
+    Matrix C(n);
+    for (unsigned i = 0; i < n; ++i) {
+        std::copy(paddedC.row(i), paddedC.row(i) + n, C.row(i));
+    }
+    return C;
+}
+
+}
@@ -1,67 +1,556 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include <chrono>
-#include <cstdlib>
+#include <cstdint>
+#include "Matrix.h"
+#include "Gemm.h"
+#include "Strassen.h"
+#include "Random.h"
+#include "../../common/Benchmark.h"
+#include "../../common/PerfCounters.h"
+#include "../../common/Topology.h"
 
-using Matrix = std::vector<std::vector<int>>;
+// Straightforward i-k-j loop, kept as the correctness reference for the
+// blocked kernel.
+Matrix multiply(const Matrix& A, const Matrix& B) {
+    unsigned n = A.getSize();
+    Matrix C(n);
+    C.fill(0);
 
-Matrix createRandomMatrix(unsigned n, int low, int high) {
-    Matrix m(n, std::vector<int>(n));
+#pragma omp parallel for
+    for (int i = 0; i < (int)n; ++i) {
+        for (int k = 0; k < (int)n; ++k) {
+            for (int j = 0; j < (int)n; ++j) {
+                C(i, j) += A(i, k) * B(k, j);
+            }
+        }
+    }
 
-    for (unsigned i = 0; i < n; ++i) {
-        for (unsigned j = 0; j < n; ++j) {
-            m[i][j] = low + std::rand() % (high - low + 1);
+    return C;
+}
+
+template <typename T>
+void printMatrix(const BasicMatrix<T>& M) {
+    for (unsigned i = 0; i < M.getSize(); ++i) {
+        for (unsigned j = 0; j < M.getSize(); ++j)
+            std::cout << M(i, j) << " ";
+        std::cout << "\n";
+    }
+}
+
+template <typename Function>
+double measureSeconds(Function&& function) {
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(finish - start).count();
+}
+
+gemm::Isa parseIsa(const std::string& name) {
+    if (name == "auto") return gemm::Isa::Auto;
+    if (name == "scalar") return gemm::Isa::Scalar;
+    if (name == "sse41") return gemm::Isa::Sse41;
+    if (name == "avx2") return gemm::Isa::Avx2;
+    throw std::invalid_argument("Unknown kernel: " + name);
+}
+
+double gops(unsigned n, double seconds) {
+    return 2.0 * n * n * n / seconds / 1e9;
+}
+
+// Pins OpenMP thread i of a team of the given size to the i-th CPU of the
+// placement. The runtime keeps its pool threads between parallel regions,
+// so the pins hold for every later region of at most that size. Threads
+// the runtime adds for a bigger team start from the master's pin, so call
+// this again after raising the thread count.
+std::vector<int> pinOpenMpThreads(const Placement& placement, int threads) {
+    const std::vector<int> cpus = PlanPlacement(CpuTopology::Detect(), placement, threads);
+#ifdef _OPENMP
+#pragma omp parallel num_threads(threads)
+    PinCurrentThread(cpus[omp_get_thread_num()]);
+#else
+    PinCurrentThread(cpus[0]);
+#endif
+    return cpus;
+}
+
+// GOPS (one multiply and one add per inner step) of the naive multiply and
+// of every micro-kernel the CPU supports, for n = 256, 512, ... maxSize.
+// The naive multiply is only timed up to naiveLimit; it takes minutes beyond.
+void runSweep(unsigned maxSize, unsigned naiveLimit, uint64_t seed) {
+    std::vector<gemm::Isa> kernels = { gemm::Isa::Scalar };
+    for (gemm::Isa isa : { gemm::Isa::Sse41, gemm::Isa::Avx2 }) {
+        if (gemm::resolveIsa(isa) == isa) {
+            kernels.push_back(isa);
         }
     }
 
-    return m;
+    std::cout << "n\tnaive";
+    for (gemm::Isa isa : kernels) {
+        std::cout << "\t" << gemm::isaName(isa) << "\t" << gemm::isaName(isa) << "-int64";
+    }
+    std::cout << "\n";
+
+    for (unsigned n = 256; n <= maxSize; n *= 2) {
+        Matrix A = createRandomMatrix(n, -100, 100, seed);
+        Matrix B = createRandomMatrix(n, -100, 100, seed + 1);
+
+        Matrix reference;
+        std::cout << n << "\t";
+        if (n <= naiveLimit) {
+            std::cout << gops(n, measureSeconds([&] { reference = multiply(A, B); }));
+        }
+        else {
+            std::cout << "-";
+        }
+
+        for (gemm::Isa isa : kernels) {
+            Matrix C;
+            Matrix64 wide;
+            std::cout << "\t" << gops(n, measureSeconds([&] { C = gemm::multiplyBlocked(A, B, isa); }));
+            std::cout << "\t" << gops(n, measureSeconds([&] { wide = gemm::multiplyBlocked<int64_t>(A, B, isa); }));
+
+            if (n <= naiveLimit && !(C == reference && wide == reference)) {
+                std::cout << " (MISMATCH)";
+            }
+        }
+        std::cout << std::endl;
+    }
 }
 
-Matrix multiply(const Matrix& A, const Matrix& B) {
-    unsigned n = A.size();
-    Matrix C(n, std::vector<int>(n, 0));
+// Times the blocked multiply and Strassen with cutoffs 64, 128, ... n / 2
+// on one pair of n x n matrices, to find where recursion starts to pay off.
+void runCrossover(unsigned n, gemm::Isa isa, uint64_t seed) {
+    Matrix A = createRandomMatrix(n, -100, 100, seed);
+    Matrix B = createRandomMatrix(n, -100, 100, seed + 1);
+
+    Matrix reference;
+    const double blockedElapsed = measureSeconds([&] { reference = gemm::multiplyBlocked(A, B, isa); });
+
+    std::cout << "cutoff\tseconds\tspeedup\n";
+    std::cout << "blocked\t" << blockedElapsed << "\t1\n";
+
+    for (unsigned cutoff = 64; cutoff < n; cutoff *= 2) {
+        gemm::StrassenOptions options;
+        options.cutoff = cutoff;
+        options.isa = isa;
+
+        Matrix C;
+        const double elapsed = measureSeconds([&] { C = gemm::multiplyStrassen(A, B, options); });
+        std::cout << cutoff << "\t" << elapsed << "\t" << blockedElapsed / elapsed;
+        if (!(C == reference)) {
+            std::cout << " (MISMATCH)";
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Freivalds' check: C x == A (B x) for a random vector x, in O(n^2) instead
+// of recomputing the product. Entries of x come from [-1024, 1024], so a
+// wrong C passes with probability at most 1/2049. Sums are 64-bit, which
+// holds for inputs in [-100, 100] up to n in the hundreds of thousands.
+template <typename T>
+bool verifyProduct(const Matrix& A, const Matrix& B, const BasicMatrix<T>& C, uint64_t seed) {
+    const unsigned n = A.getSize();
+    std::vector<int64_t> x(n), bx(n, 0), abx(n, 0), cx(n, 0);
+    // Every entry hashed on its own, as createRandomMatrix does: uniformInt
+    // keeps only the high bits, which a small offset after hashing leaves
+    // alone, so x would be one constant and only row sums would be checked.
+    const uint64_t stream = splitMix64(seed ^ 0xF4E1u);
+    for (unsigned j = 0; j < n; ++j) {
+        x[j] = uniformInt(splitMix64(stream + j), -1024, 1024);
+    }
 
 #pragma omp parallel for
     for (int i = 0; i < (int)n; ++i) {
-        for (int k = 0; k < (int)n; ++k) {
-            for (int j = 0; j < (int)n; ++j) {
-                C[i][j] += A[i][k] * B[k][j];
-            }
+        for (unsigned j = 0; j < n; ++j) {
+            bx[i] += static_cast<int64_t>(B(i, j)) * x[j];
+            cx[i] += static_cast<int64_t>(C(i, j)) * x[j];
         }
     }
 
-    return C;
+#pragma omp parallel for
+    for (int i = 0; i < (int)n; ++i) {
+        for (unsigned k = 0; k < n; ++k) {
+            abx[i] += static_cast<int64_t>(A(i, k)) * bx[k];
+        }
+    }
+
+    return abx == cx;
 }
 
-void printMatrix(const Matrix& M) {
-    for (const auto& row : M) {
-        for (int x : row)
-            std::cout << x << " ";
-        std::cout << "\n";
+// Order-sensitive fingerprint of a result; equal seeds give equal checksums
+// whatever algorithm or thread count produced the matrix.
+template <typename T>
+uint64_t matrixChecksum(const BasicMatrix<T>& C) {
+    uint64_t checksum = 0;
+    for (unsigned i = 0; i < C.getSize(); ++i) {
+        for (unsigned j = 0; j < C.getSize(); ++j) {
+            checksum += splitMix64(static_cast<uint64_t>(i) * C.getSize() + j) * static_cast<uint64_t>(C(i, j));
+        }
     }
+    return checksum;
 }
 
-int main() {
-    std::srand(time(nullptr));
+struct BatchOptions {
+    std::vector<unsigned> sizes = { 256, 512, 1024 };
+    std::vector<unsigned> threads = { 1 };
+    std::vector<std::string> algorithms = { "blocked" };
+    int warmups = 1;
+    int trials = 5;
+    uint64_t seed = 42;
+    unsigned strassenCutoff = gemm::StrassenOptions().cutoff;
+    std::string csvPath;
+    // Set by --placement; otherwise the OpenMP runtime places the threads
+    bool pinThreads = false;
+    Placement placement;
+};
 
-    unsigned n;
-    std::cout << "Matrix size: ";
-    std::cin >> n;
+std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
 
-    Matrix A = createRandomMatrix(n, -100, 100);
-    Matrix B = createRandomMatrix(n, -100, 100);
+std::vector<unsigned> parseNumberList(const std::string& list) {
+    std::vector<unsigned> numbers;
+    for (const std::string& item : splitList(list)) {
+        numbers.push_back(static_cast<unsigned>(std::stoul(item)));
+    }
+    return numbers;
+}
 
-    auto start = std::chrono::steady_clock::now();
+struct BatchResult {
+    BenchmarkResult timing;
+    uint64_t checksum;
+    bool verified;
+};
 
-    Matrix C = multiply(A, B);
+// Every trial is one multiply; trials further than 3 scaled MADs from the
+// median are dropped before the statistics are taken. The result only
+// counts as verified if Freivalds' check also rejects a copy with one
+// element off by one, so a check that passes anything cannot report yes.
+template <typename Multiply>
+BatchResult measureBatch(Multiply&& multiply, const Matrix& A, const Matrix& B, const BatchOptions& options) {
+    BenchmarkOptions benchmarkOptions;
+    benchmarkOptions.warmupRuns = options.warmups;
+    benchmarkOptions.samplesCount = std::max(options.trials, 1);
+    benchmarkOptions.minSampleSeconds = 0.0;
 
-    auto finish = std::chrono::steady_clock::now();
-    std::chrono::duration<double> elapsed = finish - start;
+    decltype(multiply()) C;
+    Benchmark harness(benchmarkOptions);
+    BenchmarkResult timing = harness.Run("multiply", [&] { C = multiply(); });
 
-    std::cout << "\nResult matrix:\n";
-    printMatrix(C);
+    auto corrupted = C;
+    const unsigned n = corrupted.getSize();
+    if (n > 0) {
+        corrupted(n / 2, n / 3) += 1;
+    }
+    const bool verified = verifyProduct(A, B, C, options.seed) && (n == 0 || !verifyProduct(A, B, corrupted, options.seed));
+
+    return { timing, matrixChecksum(C), verified };
+}
+
+BatchResult runAlgorithm(const std::string& algorithm, const Matrix& A, const Matrix& B,
+    gemm::Isa isa, const BatchOptions& options) {
+    if (algorithm == "naive") {
+        return measureBatch([&] { return multiply(A, B); }, A, B, options);
+    }
+    if (algorithm == "blocked") {
+        return measureBatch([&] { return gemm::multiplyBlocked(A, B, isa); }, A, B, options);
+    }
+    if (algorithm == "blocked-int64") {
+        return measureBatch([&] { return gemm::multiplyBlocked<int64_t>(A, B, isa); }, A, B, options);
+    }
+    if (algorithm == "strassen") {
+        gemm::StrassenOptions strassen;
+        strassen.cutoff = options.strassenCutoff;
+        strassen.isa = isa;
+        return measureBatch([&] { return gemm::multiplyStrassen(A, B, strassen); }, A, B, options);
+    }
+    throw std::invalid_argument("Unknown algorithm: " + algorithm);
+}
 
-    std::cout << "\nExecution time: " << elapsed.count() << " seconds\n";
+// One CSV row per algorithm, size and thread count. Speedup and efficiency
+// are relative to the smallest thread count of the same algorithm and size,
+// scaled as if that run were linear: with threads 1,2,4 it is plain T1/Tp.
+void runBatch(const BatchOptions& options, gemm::Isa isa) {
+    std::ofstream file;
+    if (!options.csvPath.empty()) {
+        file.open(options.csvPath);
+        if (!file) {
+            throw std::runtime_error("Cannot open file: " + options.csvPath);
+        }
+    }
+    std::ostream& csv = options.csvPath.empty() ? std::cout : file;
+
+    std::vector<unsigned> threadCounts = options.threads;
+    std::sort(threadCounts.begin(), threadCounts.end());
+
+    csv << "algorithm,kernel,n,threads,trials,rejected,median_s,mad_s,min_s,stddev_s,gflops,speedup,efficiency,checksum,verified\n";
+
+    for (unsigned n : options.sizes) {
+        const Matrix A = createRandomMatrix(n, -100, 100, options.seed);
+        const Matrix B = createRandomMatrix(n, -100, 100, options.seed + 1);
+
+        for (const std::string& algorithm : options.algorithms) {
+            double baselineWork = 0.0;
+
+            for (unsigned threads : threadCounts) {
+#ifdef _OPENMP
+                omp_set_num_threads(static_cast<int>(threads));
+#endif
+                if (options.pinThreads) {
+                    pinOpenMpThreads(options.placement, static_cast<int>(threads));
+                }
+                const BatchResult result = runAlgorithm(algorithm, A, B, isa, options);
+                const double median = result.timing.median;
+                if (baselineWork == 0.0) {
+                    baselineWork = median * threads;
+                }
+                const double speedup = baselineWork / median;
+
+                csv << algorithm << "," << gemm::isaName(gemm::resolveIsa(isa)) << "," << n << "," << threads << ","
+                    << options.trials << "," << result.timing.rejectedCount << "," << median << ","
+                    << result.timing.mad << "," << result.timing.min << "," << result.timing.stddev << ","
+                    << gops(n, median) << "," << speedup << "," << speedup / threads << ","
+                    << result.checksum << "," << (result.verified ? "yes" : "no") << std::endl;
+            }
+        }
+    }
+}
+
+void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [matrix-size] [--verify] [--perf] [--kernel=auto|scalar|sse41|avx2]"
+        << " [--int64 | --strassen[=cutoff]] [--seed=N] [--placement=linear|compact|scatter|physical|numa[:node]]"
+        << " [--topology]\n"
+        << "       " << program << " --sweep[=max-size]\n"
+        << "       " << program << " --crossover[=matrix-size]\n"
+        << "       " << program << " --batch [--sizes=256,512,...] [--threads=1,2,...]"
+        << " [--algorithms=naive,blocked,blocked-int64,strassen] [--trials=N] [--warmups=N] [--csv=path]"
+        << " [--strassen=cutoff] [--kernel=...] [--seed=N] [--placement=...]\n";
+}
+
+// Usage: Task3 [matrix-size] [--verify] [--perf] [--kernel=auto|scalar|sse41|avx2] [--int64 | --strassen[=cutoff]] [--seed=N]
+//              [--placement=linear|compact|scatter|physical|numa[:node]] [--topology]
+//        Task3 --sweep[=max-size]
+//        Task3 --crossover[=matrix-size]
+//        Task3 --batch [--sizes=256,512,...] [--threads=1,2,...] [--algorithms=naive,blocked,blocked-int64,strassen]
+//              [--trials=N] [--warmups=N] [--csv=path] [--strassen=cutoff] [--kernel=...] [--seed=N] [--placement=...]
+// Without a size the program asks for one. --verify also runs the naive
+// multiply and compares the results. --int64 accumulates in 64 bits, so
+// the product cannot wrap whatever the size. --strassen recurses with
+// Strassen-Winograd down to the cutoff (512 by default). --perf reads the
+// hardware counters of every thread during the multiply. --batch prints
+// CSV and checks every result in O(n^2) instead of printing it.
+// --placement pins the OpenMP threads to CPUs chosen from the topology;
+// --topology prints the topology and the CPUs picked.
+int main(int argc, char** argv) {
+    constexpr unsigned MAX_PRINTED_SIZE = 16;
+    constexpr unsigned NAIVE_SWEEP_LIMIT = 2048;
+
+    unsigned n = 0;
+    bool verify = false;
+    bool countEvents = false;
+    bool wide = false;
+    bool batch = false;
+    bool showTopology = false;
+    unsigned sweepSize = 0;
+    unsigned crossoverSize = 0;
+    unsigned strassenCutoff = 0;
+    gemm::Isa isa = gemm::Isa::Auto;
+    BatchOptions batchOptions;
+
+    auto value = [](const std::string& arg) {
+        return arg.substr(arg.find('=') + 1);
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        try {
+            if (arg == "--verify") {
+                verify = true;
+            }
+            else if (arg == "--perf") {
+                countEvents = true;
+            }
+            else if (arg == "--int64") {
+                wide = true;
+            }
+            else if (arg == "--batch") {
+                batch = true;
+            }
+            else if (arg.rfind("--kernel=", 0) == 0) {
+                isa = parseIsa(value(arg));
+            }
+            else if (arg == "--sweep") {
+                sweepSize = 8192;
+            }
+            else if (arg.rfind("--sweep=", 0) == 0) {
+                sweepSize = static_cast<unsigned>(std::stoul(value(arg)));
+            }
+            else if (arg == "--strassen") {
+                strassenCutoff = gemm::StrassenOptions().cutoff;
+            }
+            else if (arg.rfind("--strassen=", 0) == 0) {
+                strassenCutoff = static_cast<unsigned>(std::stoul(value(arg)));
+                batchOptions.strassenCutoff = strassenCutoff;
+            }
+            else if (arg == "--crossover") {
+                crossoverSize = 2048;
+            }
+            else if (arg.rfind("--crossover=", 0) == 0) {
+                crossoverSize = static_cast<unsigned>(std::stoul(value(arg)));
+            }
+            else if (arg.rfind("--sizes=", 0) == 0) {
+                batchOptions.sizes = parseNumberList(value(arg));
+            }
+            else if (arg.rfind("--threads=", 0) == 0) {
+                batchOptions.threads = parseNumberList(value(arg));
+            }
+            else if (arg.rfind("--algorithms=", 0) == 0) {
+                batchOptions.algorithms = splitList(value(arg));
+            }
+            else if (arg.rfind("--trials=", 0) == 0) {
+                batchOptions.trials = std::stoi(value(arg));
+            }
+            else if (arg.rfind("--warmups=", 0) == 0) {
+                batchOptions.warmups = std::stoi(value(arg));
+            }
+            else if (arg.rfind("--seed=", 0) == 0) {
+                batchOptions.seed = std::stoull(value(arg));
+            }
+            else if (arg.rfind("--csv=", 0) == 0) {
+                batchOptions.csvPath = value(arg);
+            }
+            else if (arg.rfind("--placement=", 0) == 0) {
+                batchOptions.placement = Placement::Parse(value(arg));
+                batchOptions.pinThreads = true;
+            }
+            else if (arg == "--topology") {
+                showTopology = true;
+            }
+            else {
+                n = static_cast<unsigned>(std::stoul(arg));
+            }
+        }
+        catch (const std::exception& error) {
+            std::cerr << "Invalid argument " << arg << ": " << error.what() << "\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    const uint64_t seed = batchOptions.seed;
+
+    try {
+        if (showTopology) {
+            std::cout << "Topology: " << CpuTopology::Detect().Describe() << "\n";
+        }
+        if (batchOptions.pinThreads && !batch) {
+#ifdef _OPENMP
+            const int threads = omp_get_max_threads();
+#else
+            const int threads = 1;
+#endif
+            const std::vector<int> cpus = pinOpenMpThreads(batchOptions.placement, threads);
+            if (showTopology) {
+                std::cout << "Placement " << batchOptions.placement.getName() << ": CPUs " << FormatCpuList(cpus) << "\n";
+            }
+        }
+        if (batch) {
+            runBatch(batchOptions, isa);
+            return 0;
+        }
+    }
+    catch (const std::exception& error) {
+        std::cerr << "Error: " << error.what() << "\n";
+        return 1;
+    }
+
+    if (sweepSize > 0) {
+        runSweep(sweepSize, NAIVE_SWEEP_LIMIT, seed);
+        return 0;
+    }
+
+    if (crossoverSize > 0) {
+        runCrossover(crossoverSize, isa, seed);
+        return 0;
+    }
+
+    if (wide && strassenCutoff > 0) {
+        std::cerr << "--int64 and --strassen cannot be combined\n";
+        return 1;
+    }
+
+    if (n == 0) {
+        std::cout << "Matrix size: ";
+        std::cin >> n;
+    }
+
+    Matrix A = createRandomMatrix(n, -100, 100, seed);
+    Matrix B = createRandomMatrix(n, -100, 100, seed + 1);
+    Matrix C;
+    Matrix64 C64;
+    auto multiplyOnce = [&] {
+        if (wide) {
+            C64 = gemm::multiplyBlocked<int64_t>(A, B, isa);
+        }
+        else if (strassenCutoff > 0) {
+            gemm::StrassenOptions options;
+            options.cutoff = strassenCutoff;
+            options.isa = isa;
+            C = gemm::multiplyStrassen(A, B, options);
+        }
+        else {
+            C = gemm::multiplyBlocked(A, B, isa);
+        }
+    };
+
+    PerfReport counters;
+    const double elapsed = countEvents ?
+        measureSeconds([&] { counters = MeasureOpenMp(multiplyOnce); }) : measureSeconds(multiplyOnce);
+
+    if (n <= MAX_PRINTED_SIZE) {
+        std::cout << "\nResult matrix:\n";
+        if (wide) {
+            printMatrix(C64);
+        }
+        else {
+            printMatrix(C);
+        }
+    }
+
+    std::cout << "\nKernel: " << gemm::isaName(gemm::resolveIsa(isa)) << (wide ? " (int64 accumulators)" : "")
+        << (strassenCutoff > 0 ? ", Strassen-Winograd above " + std::to_string(strassenCutoff) : "") << "\n";
+    std::cout << "Execution time: " << elapsed << " seconds (" << gops(n, elapsed) << " GOPS)\n";
+    if (countEvents) {
+        counters.Print(std::cout, "Counters");
+    }
+
+    if (verify) {
+        Matrix reference;
+        double referenceElapsed = measureSeconds([&] { reference = multiply(A, B); });
+        const bool passed = wide ? C64 == reference : C == reference;
+
+        std::cout << "Naive execution time: " << referenceElapsed << " seconds\n";
+        std::cout << "Verification: " << (passed ? "passed" : "FAILED") << "\n";
+        if (!passed) {
+            return 1;
+        }
+    }
 
     return 0;
 }
@@ -0,0 +1,316 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "ThreadAffinity.h"
+
+// Header-only timing harness shared by the labs. A Run executes the body a
+// few times to warm caches and page tables, picks how many calls make up
+// one sample so that a sample lasts at least minSampleSeconds, then times
+// samplesCount samples with the monotonic wall clock. Samples further than
+// outlierThreshold scaled MADs from the median are dropped before the
+// statistics are taken, so one preempted sample does not move the result.
+
+struct BenchmarkOptions {
+    int warmupRuns = 1;
+    int samplesCount = 10;
+    double minSampleSeconds = 0.01;
+    int maxCallsPerSample = 1 << 20;
+    // In scaled MADs (1.4826 * MAD estimates the standard deviation); 0 keeps every sample.
+    double outlierThreshold = 3.0;
+    // Core to pin the calling thread to while measuring; -1 leaves it alone.
+    // Threads the body creates inherit the pin on Linux.
+    int pinnedCore = -1;
+    std::string jsonPath;
+    std::string csvPath;
+
+    // Accepts --samples=, --warmups=, --min-time= (seconds), --pin=, --json=
+    // and --csv=. Returns false for anything else, so a lab can parse its
+    // own flags around these.
+    bool ParseFlag(const std::string& arg) {
+        auto value = [&arg](const char* prefix) -> const char* {
+            const size_t length = std::char_traits<char>::length(prefix);
+            return arg.compare(0, length, prefix) == 0 ? arg.c_str() + length : nullptr;
+        };
+
+        if (const char* samples = value("--samples=")) {
+            samplesCount = std::max(1, std::stoi(samples));
+        }
+        else if (const char* warmups = value("--warmups=")) {
+            warmupRuns = std::max(0, std::stoi(warmups));
+        }
+        else if (const char* minTime = value("--min-time=")) {
+            minSampleSeconds = std::stod(minTime);
+        }
+        else if (const char* core = value("--pin=")) {
+            pinnedCore = std::stoi(core);
+        }
+        else if (const char* json = value("--json=")) {
+            jsonPath = json;
+        }
+        else if (const char* csv = value("--csv=")) {
+            csvPath = csv;
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    static const char* getUsage() {
+        return "[--samples=N] [--warmups=N] [--min-time=seconds] [--pin=core] [--json=path] [--csv=path]";
+    }
+};
+
+// All times are seconds per call.
+struct BenchmarkResult {
+    std::string name;
+    int callsPerSample = 1;
+    std::vector<double> samples;
+    size_t rejectedCount = 0;
+    double median = 0.0;
+    double mad = 0.0;
+    double mean = 0.0;
+    double stddev = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+
+    // Linear interpolation between the closest kept samples; p in [0, 100].
+    double getPercentile(double p) const {
+        if (samples.empty()) {
+            return 0.0;
+        }
+        std::vector<double> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        const double position = p / 100.0 * (sorted.size() - 1);
+        const size_t lower = static_cast<size_t>(position);
+        const size_t upper = std::min(lower + 1, sorted.size() - 1);
+        return sorted[lower] + (position - lower) * (sorted[upper] - sorted[lower]);
+    }
+};
+
+class Benchmark {
+public:
+    explicit Benchmark(const BenchmarkOptions& options = BenchmarkOptions())
+        : options(options) {
+    }
+
+    const BenchmarkOptions& getOptions() const {
+        return options;
+    }
+
+    const std::vector<BenchmarkResult>& getResults() const {
+        return results;
+    }
+
+    // Measures body() and returns a copy of the statistics, which are also
+    // kept for WriteReports. A copy, because a later Run may move the kept
+    // ones. A non-void result of the body is written to a volatile sink so
+    // the call cannot be optimised away.
+    template <typename Body>
+    BenchmarkResult Run(const std::string& name, Body&& body) {
+        std::unique_ptr<ScopedThreadPin> pin;
+        if (options.pinnedCore >= 0) {
+            pin = std::make_unique<ScopedThreadPin>(options.pinnedCore);
+        }
+
+        // The last warm-up call (or one extra call without warm-ups) sizes the
+        // samples; bodies slower than minSampleSeconds run once per sample.
+        double calibration = 0.0;
+        for (int i = 0; i < std::max(options.warmupRuns, 1); ++i) {
+            calibration = Time(body, 1);
+        }
+
+        BenchmarkResult result;
+        result.name = name;
+        if (calibration > 0.0 && calibration < options.minSampleSeconds) {
+            result.callsPerSample = static_cast<int>(std::min<double>(options.maxCallsPerSample,
+                std::ceil(options.minSampleSeconds / calibration)));
+        }
+
+        std::vector<double> samples;
+        for (int i = 0; i < options.samplesCount; ++i) {
+            samples.push_back(Time(body, result.callsPerSample) / result.callsPerSample);
+        }
+
+        Summarize(samples, result);
+        results.push_back(result);
+        return result;
+    }
+
+    void WriteCsv(std::ostream& output) const {
+        output << "name,calls_per_sample,samples,rejected,median_s,mad_s,mean_s,stddev_s,min_s,max_s,p5_s,p95_s,p99_s\n";
+        for (const BenchmarkResult& result : results) {
+            output << EscapeCsv(result.name) << "," << result.callsPerSample << "," << result.samples.size() << ","
+                << result.rejectedCount << "," << result.median << "," << result.mad << "," << result.mean << ","
+                << result.stddev << "," << result.min << "," << result.max << "," << result.getPercentile(5) << ","
+                << result.getPercentile(95) << "," << result.getPercentile(99) << "\n";
+        }
+    }
+
+    void WriteJson(std::ostream& output) const {
+        output << "{\"benchmarks\":[";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const BenchmarkResult& result = results[i];
+            output << (i ? ",\n" : "\n") << "{\"name\":\"" << EscapeJson(result.name) << "\""
+                << ",\"callsPerSample\":" << result.callsPerSample
+                << ",\"rejected\":" << result.rejectedCount
+                << ",\"median\":" << result.median << ",\"mad\":" << result.mad
+                << ",\"mean\":" << result.mean << ",\"stddev\":" << result.stddev
+                << ",\"min\":" << result.min << ",\"max\":" << result.max
+                << ",\"p5\":" << result.getPercentile(5) << ",\"p95\":" << result.getPercentile(95)
+                << ",\"p99\":" << result.getPercentile(99) << ",\"samples\":[";
+            for (size_t j = 0; j < result.samples.size(); ++j) {
+                output << (j ? "," : "") << result.samples[j];
+            }
+            output << "]}";
+        }
+        output << "\n]}\n";
+    }
+
+    // Writes the files named by jsonPath and csvPath, if any.
+    void WriteReports() const {
+        if (!options.jsonPath.empty()) {
+            std::ofstream file(options.jsonPath);
+            if (!file) {
+                throw std::runtime_error("Cannot open file: " + options.jsonPath);
+            }
+            WriteJson(file);
+        }
+        if (!options.csvPath.empty()) {
+            std::ofstream file(options.csvPath);
+            if (!file) {
+                throw std::runtime_error("Cannot open file: " + options.csvPath);
+            }
+            WriteCsv(file);
+        }
+    }
+
+    // "median 12.3 ms (MAD 0.4 ms, p95 13.1 ms, 10 samples x 4 calls, 1 rejected)"
+    static std::string FormatSummary(const BenchmarkResult& result) {
+        return "median " + FormatSeconds(result.median) + " (MAD " + FormatSeconds(result.mad)
+            + ", p95 " + FormatSeconds(result.getPercentile(95)) + ", " + std::to_string(result.samples.size())
+            + " samples x " + std::to_string(result.callsPerSample) + " calls, "
+            + std::to_string(result.rejectedCount) + " rejected)";
+    }
+
+    static std::string FormatSeconds(double seconds) {
+        const char* unit = "s";
+        if (seconds < 1e-3) {
+            seconds *= 1e6;
+            unit = "us";
+        }
+        else if (seconds < 1.0) {
+            seconds *= 1e3;
+            unit = "ms";
+        }
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.3g %s", seconds, unit);
+        return buffer;
+    }
+
+private:
+    template <typename Body>
+    static void Call(Body& body) {
+        if constexpr (std::is_void_v<decltype(body())>) {
+            body();
+        }
+        else {
+            auto value = body();
+            if constexpr (std::is_arithmetic_v<decltype(value)>) {
+                static volatile decltype(value) sink;
+                sink = value;
+            }
+        }
+    }
+
+    template <typename Body>
+    static double Time(Body& body, int calls) {
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < calls; ++i) {
+            Call(body);
+        }
+        const auto finish = std::chrono::steady_clock::now();
+        return std::chrono::duration<double>(finish - start).count();
+    }
+
+    static double Median(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        const size_t count = values.size();
+        return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+    }
+
+    static double MedianAbsoluteDeviation(const std::vector<double>& values, double median) {
+        std::vector<double> deviations;
+        for (double value : values) {
+            deviations.push_back(std::abs(value - median));
+        }
+        return Median(deviations);
+    }
+
+    void Summarize(const std::vector<double>& allSamples, BenchmarkResult& result) const {
+        const double median = Median(allSamples);
+        const double limit = options.outlierThreshold * 1.4826 * MedianAbsoluteDeviation(allSamples, median);
+
+        for (double sample : allSamples) {
+            if (options.outlierThreshold > 0.0 && limit > 0.0 && std::abs(sample - median) > limit) {
+                result.rejectedCount++;
+            }
+            else {
+                result.samples.push_back(sample);
+            }
+        }
+
+        const std::vector<double>& kept = result.samples;
+        result.median = Median(kept);
+        result.mad = MedianAbsoluteDeviation(kept, result.median);
+        result.min = *std::min_element(kept.begin(), kept.end());
+        result.max = *std::max_element(kept.begin(), kept.end());
+
+        for (double sample : kept) {
+            result.mean += sample / kept.size();
+        }
+        double variance = 0.0;
+        for (double sample : kept) {
+            variance += (sample - result.mean) * (sample - result.mean);
+        }
+        result.stddev = kept.size() > 1 ? std::sqrt(variance / (kept.size() - 1)) : 0.0;
+    }
+
+    static std::string EscapeJson(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+            }
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    static std::string EscapeCsv(const std::string& text) {
+        if (text.find_first_of(",\"\n") == std::string::npos) {
+            return text;
+        }
+        std::string escaped = "\"";
+        for (char c : text) {
+            escaped += c;
+            if (c == '"') {
+                escaped += '"';
+            }
+        }
+        return escaped + "\"";
+    }
+
+    BenchmarkOptions options;
+    std::vector<BenchmarkResult> results;
+};
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#pragma pack(push, 1)
+
+struct BMPFileHeader {
+    uint16_t fileType;
+    uint32_t fileSize;
+    uint16_t reserved1;
+    uint16_t reserved2;
+    uint32_t offsetData;
+};
+
+struct BMPInfoHeader {
+    uint32_t size;
+    int32_t width;
+    int32_t height;
+    uint16_t planes;
+    uint16_t bitCount;
+    uint32_t compression;
+    uint32_t sizeImage;
+    int32_t xPixelsPerMeter;
+    int32_t yPixelsPerMeter;
+    uint32_t colorsUsed;
+    uint32_t colorsImportant;
+};
+
+#pragma pack(pop)
+
+// Where and how the pixel array of an uncompressed 24/32-bit BMP is stored.
+// Rows are padded to 4 bytes and stored bottom-up unless the header height
+// is negative.
+struct BmpLayout {
+    int width = 0;
+    int height = 0;
+    int bytesPerPixel = 0;
+    bool topDown = false;
+    size_t stride = 0;
+    uint32_t pixelOffset = 0;
+
+    size_t getPixelArraySize() const {
+        return stride * height;
+    }
+
+    // Stored rows are bottom-up by default; maps an image row (0 = top) to
+    // its index in the file.
+    int storedRow(int y) const {
+        return topDown ? y : height - 1 - y;
+    }
+};
+
+// Parses the file and info headers at the start of data. Any header that
+// starts with the 40-byte BITMAPINFOHEADER fields (V4/V5 included) is
+// accepted; everything up to pixelOffset is treated as opaque header bytes.
+inline BmpLayout ParseBmpHeaders(const uint8_t* data, size_t size, const std::string& path) {
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    if (size < sizeof(fileHeader) + sizeof(infoHeader)) {
+        throw std::runtime_error("Not a valid BMP file: " + path);
+    }
+
+    memcpy(&fileHeader, data, sizeof(fileHeader));
+    memcpy(&infoHeader, data + sizeof(fileHeader), sizeof(infoHeader));
+
+    if (fileHeader.fileType != 0x4D42) {
+        throw std::runtime_error("Not a valid BMP file: " + path);
+    }
+
+    const uint32_t BI_RGB_FORMAT = 0;
+    const uint32_t BI_BITFIELDS_FORMAT = 3;
+    const int bitCount = infoHeader.bitCount;
+    if ((bitCount != 24 && bitCount != 32) ||
+        (infoHeader.compression != BI_RGB_FORMAT &&
+            !(infoHeader.compression == BI_BITFIELDS_FORMAT && bitCount == 32))) {
+        throw std::runtime_error("Only uncompressed 24/32-bit BMP files are supported: " + path);
+    }
+
+    BmpLayout layout;
+    layout.width = infoHeader.width;
+    layout.height = std::abs(infoHeader.height);
+    layout.bytesPerPixel = bitCount / 8;
+    layout.topDown = infoHeader.height < 0;
+    layout.stride = ((static_cast<size_t>(layout.width) * bitCount + 31) / 32) * 4;
+    layout.pixelOffset = fileHeader.offsetData;
+
+    if (layout.width <= 0 || layout.height == 0 ||
+        layout.pixelOffset < sizeof(fileHeader) + sizeof(infoHeader)) {
+        throw std::runtime_error("Invalid BMP dimensions: " + path);
+    }
+
+    return layout;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+// Runtime x86 feature detection, so SIMD kernels can be compiled into every
+// build and picked on the machine that actually runs them. TARGET_* marks a
+// function that may use the matching instructions even when the rest of the
+// translation unit is compiled for the baseline ISA.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CPU_FEATURES_X86 1
+#else
+#define CPU_FEATURES_X86 0
+#endif
+
+#if CPU_FEATURES_X86 && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#include <immintrin.h>
+#define TARGET_SSE41
+#define TARGET_AVX2
+#define TARGET_AVX2_FMA
+#elif CPU_FEATURES_X86
+#include <immintrin.h>
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX2_FMA __attribute__((target("avx2,fma")))
+#endif
+
+struct CpuFeatures {
+    bool sse2 = false;
+    bool sse41 = false;
+    bool avx2 = false;
+    bool fma = false;
+
+    static const CpuFeatures& Get() {
+        static const CpuFeatures features = Detect();
+        return features;
+    }
+
+private:
+    static CpuFeatures Detect() {
+        CpuFeatures features;
+#if CPU_FEATURES_X86 && defined(_MSC_VER) && !defined(__clang__)
+        int registers[4];
+        __cpuid(registers, 0);
+        const int maxLeaf = registers[0];
+
+        __cpuid(registers, 1);
+        features.sse2 = (registers[3] & (1 << 26)) != 0;
+        features.sse41 = (registers[2] & (1 << 19)) != 0;
+        const bool fma = (registers[2] & (1 << 12)) != 0;
+        const bool osSavesYmm = (registers[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+
+        if (maxLeaf >= 7 && osSavesYmm) {
+            __cpuidex(registers, 7, 0);
+            features.avx2 = (registers[1] & (1 << 5)) != 0;
+            features.fma = fma;
+        }
+#elif CPU_FEATURES_X86
+        __builtin_cpu_init();
+        features.sse2 = __builtin_cpu_supports("sse2");
+        features.sse41 = __builtin_cpu_supports("sse4.1");
+        features.avx2 = __builtin_cpu_supports("avx2");
+        features.fma = __builtin_cpu_supports("fma");
+#endif
+        return features;
+    }
+};
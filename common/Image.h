@@ -0,0 +1,147 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "BmpFormat.h"
+#include "ImageView.h"
+
+// In-memory image shared by the blur labs. Rows are kept top to bottom
+// whatever the file orientation, and every row starts on a ROW_ALIGNMENT
+// boundary, so kernels can run aligned vector loads along a row and only
+// the first and last pixels of a row need edge handling. The headers of the
+// file it was loaded from are kept verbatim and written back by SaveBmp.
+class Image {
+public:
+    static constexpr size_t ROW_ALIGNMENT = 64;
+
+    Image() = default;
+
+    Image(const Image& other) {
+        *this = other;
+    }
+
+    Image& operator=(const Image& other) {
+        if (this != &other) {
+            Allocate(other.layout, other.headerBytes);
+            if (pixels) {
+                memcpy(pixels.get(), other.pixels.get(), stride * layout.height);
+            }
+        }
+        return *this;
+    }
+
+    Image(Image&&) noexcept = default;
+    Image& operator=(Image&&) noexcept = default;
+
+    static Image LoadBmp(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Cannot open file: " + path);
+        }
+
+        std::vector<uint8_t> headerBytes(sizeof(BMPFileHeader) + sizeof(BMPInfoHeader));
+        file.read(reinterpret_cast<char*>(headerBytes.data()), headerBytes.size());
+        BmpLayout layout = ParseBmpHeaders(headerBytes.data(), static_cast<size_t>(file.gcount()), path);
+
+        headerBytes.resize(layout.pixelOffset);
+        file.read(reinterpret_cast<char*>(headerBytes.data()) + sizeof(BMPFileHeader) + sizeof(BMPInfoHeader),
+            layout.pixelOffset - sizeof(BMPFileHeader) - sizeof(BMPInfoHeader));
+
+        Image image;
+        image.Allocate(layout, std::move(headerBytes));
+
+        const size_t rowBytes = static_cast<size_t>(layout.width) * layout.bytesPerPixel;
+        std::vector<char> padding(layout.stride - rowBytes);
+        for (int storedRow = 0; storedRow < layout.height; ++storedRow) {
+            const int y = layout.storedRow(storedRow);
+            file.read(reinterpret_cast<char*>(image.view().row(y)), rowBytes);
+            file.read(padding.data(), padding.size());
+        }
+
+        if (!file) {
+            throw std::runtime_error("Truncated BMP file: " + path);
+        }
+
+        return image;
+    }
+
+    void SaveBmp(const std::string& path) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            throw std::runtime_error("Cannot open file: " + path);
+        }
+
+        file.write(reinterpret_cast<const char*>(headerBytes.data()), headerBytes.size());
+
+        const size_t rowBytes = static_cast<size_t>(layout.width) * layout.bytesPerPixel;
+        const std::vector<char> padding(layout.stride - rowBytes, 0);
+        for (int storedRow = 0; storedRow < layout.height; ++storedRow) {
+            const int y = layout.storedRow(storedRow);
+            file.write(reinterpret_cast<const char*>(view().row(y)), rowBytes);
+            file.write(padding.data(), padding.size());
+        }
+
+        if (!file) {
+            throw std::runtime_error("Cannot write file: " + path);
+        }
+    }
+
+    // Same dimensions and headers as layout. Pixel memory is allocated but
+    // not touched, so the first thread to write a row also places its pages.
+    static Image CreateLike(const Image& layout) {
+        Image image;
+        image.Allocate(layout.layout, layout.headerBytes);
+        return image;
+    }
+
+    int getWidth() const {
+        return layout.width;
+    }
+
+    int getHeight() const {
+        return layout.height;
+    }
+
+    int getBytesPerPixel() const {
+        return layout.bytesPerPixel;
+    }
+
+    // Bytes between row starts in memory, a multiple of ROW_ALIGNMENT.
+    size_t getStride() const {
+        return stride;
+    }
+
+    ImageView view() const {
+        return { pixels.get(), layout.width, layout.height, layout.bytesPerPixel,
+            static_cast<ptrdiff_t>(stride) };
+    }
+
+private:
+    struct AlignedDeleter {
+        void operator()(uint8_t* memory) const {
+            ::operator delete[](memory, std::align_val_t(ROW_ALIGNMENT));
+        }
+    };
+
+    void Allocate(const BmpLayout& newLayout, std::vector<uint8_t> newHeaderBytes) {
+        layout = newLayout;
+        headerBytes = std::move(newHeaderBytes);
+
+        const size_t rowBytes = static_cast<size_t>(layout.width) * layout.bytesPerPixel;
+        stride = (rowBytes + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+        pixels.reset(stride * layout.height == 0 ? nullptr : static_cast<uint8_t*>(
+            ::operator new[](stride * layout.height, std::align_val_t(ROW_ALIGNMENT))));
+    }
+
+    BmpLayout layout;
+    std::vector<uint8_t> headerBytes;
+    size_t stride = 0;
+    std::unique_ptr<uint8_t[], AlignedDeleter> pixels;
+};
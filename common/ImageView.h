@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Non-owning view of interleaved 8-bit pixels. Row y starts at
+// data + y * stride, so a bottom-up buffer is viewed top to bottom by
+// pointing data at its last stored row and using a negative stride.
+struct ImageView {
+    uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+    int bytesPerPixel = 0;
+    ptrdiff_t stride = 0;
+
+    uint8_t* row(int y) const {
+        return data + y * stride;
+    }
+
+    uint8_t* pixel(int x, int y) const {
+        return row(y) + static_cast<ptrdiff_t>(x) * bytesPerPixel;
+    }
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include "BmpFormat.h"
+#include "ImageView.h"
+#include "MappedFile.h"
+
+// Uncompressed 24/32-bit BMP accessed in place through a file mapping.
+// Pixels keep their on-disk BGR(A) order and row padding; view() exposes the
+// rows top to bottom whatever the stored orientation, so filters can read a
+// mapped input and write a mapped output without any intermediate copy.
+class MappedBitmap {
+public:
+    static MappedBitmap Open(const std::string& path) {
+        return MappedBitmap(MappedFile::OpenReadOnly(path), path);
+    }
+
+    // Creates path with the same headers and pixel layout as source and maps
+    // it read-write. Only the headers are copied; pixel rows start zeroed.
+    static MappedBitmap CreateLike(const std::string& path, const MappedBitmap& source) {
+        MappedFile file = MappedFile::Create(path, source.file.getSize());
+        memcpy(file.getData(), source.file.getData(), source.layout.pixelOffset);
+        return MappedBitmap(std::move(file), path);
+    }
+
+    int getWidth() const {
+        return layout.width;
+    }
+
+    int getHeight() const {
+        return layout.height;
+    }
+
+    int getBytesPerPixel() const {
+        return layout.bytesPerPixel;
+    }
+
+    // Bytes per stored row, including the padding to a 4-byte boundary.
+    size_t getStride() const {
+        return layout.stride;
+    }
+
+    bool isTopDown() const {
+        return layout.topDown;
+    }
+
+    ImageView view() const {
+        uint8_t* pixels = file.getData() + layout.pixelOffset;
+        ptrdiff_t rowStride = static_cast<ptrdiff_t>(layout.stride);
+        if (!layout.topDown) {
+            pixels += (layout.height - 1) * rowStride;
+            rowStride = -rowStride;
+        }
+        return { pixels, layout.width, layout.height, layout.bytesPerPixel, rowStride };
+    }
+
+private:
+    MappedBitmap(MappedFile mappedFile, const std::string& path)
+        : file(std::move(mappedFile)), layout(ParseBmpHeaders(file.getData(), file.getSize(), path)) {
+        if (layout.pixelOffset + layout.getPixelArraySize() > file.getSize()) {
+            throw std::runtime_error("Truncated BMP file: " + path);
+        }
+    }
+
+    MappedFile file;
+    BmpLayout layout;
+};
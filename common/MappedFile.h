@@ -0,0 +1,154 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Whole-file memory mapping. Pages are faulted in on first access and, for
+// writable mappings, written back by the OS, so the file is never staged in
+// a heap buffer.
+class MappedFile {
+public:
+    static MappedFile OpenReadOnly(const std::string& path) {
+        MappedFile mapped;
+#ifdef _WIN32
+        mapped.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (mapped.file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Cannot open file: " + path);
+        }
+
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(mapped.file, &fileSize);
+        mapped.length = static_cast<size_t>(fileSize.QuadPart);
+        mapped.Map(path, false);
+#else
+        mapped.descriptor = open(path.c_str(), O_RDONLY);
+        if (mapped.descriptor < 0) {
+            throw std::runtime_error("Cannot open file: " + path);
+        }
+
+        struct stat fileStat;
+        fstat(mapped.descriptor, &fileStat);
+        mapped.length = static_cast<size_t>(fileStat.st_size);
+        mapped.Map(path, false);
+#endif
+        return mapped;
+    }
+
+    // Creates (or truncates) path, sizes it to size bytes and maps it read-write.
+    static MappedFile Create(const std::string& path, size_t size) {
+        MappedFile mapped;
+        mapped.length = size;
+#ifdef _WIN32
+        mapped.file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (mapped.file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Cannot create file: " + path);
+        }
+#else
+        mapped.descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (mapped.descriptor < 0 || ftruncate(mapped.descriptor, static_cast<off_t>(size)) != 0) {
+            throw std::runtime_error("Cannot create file: " + path);
+        }
+#endif
+        mapped.Map(path, true);
+        return mapped;
+    }
+
+    MappedFile(MappedFile&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            Close();
+            std::swap(address, other.address);
+            std::swap(length, other.length);
+#ifdef _WIN32
+            std::swap(file, other.file);
+            std::swap(mapping, other.mapping);
+#else
+            std::swap(descriptor, other.descriptor);
+#endif
+        }
+        return *this;
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        Close();
+    }
+
+    uint8_t* getData() const {
+        return address;
+    }
+
+    size_t getSize() const {
+        return length;
+    }
+
+private:
+    MappedFile() = default;
+
+    void Map(const std::string& path, bool writable) {
+        if (length == 0) {
+            throw std::runtime_error("Cannot map empty file: " + path);
+        }
+#ifdef _WIN32
+        mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+            static_cast<DWORD>(static_cast<uint64_t>(length) >> 32), static_cast<DWORD>(length), nullptr);
+        void* view = mapping ? MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, length) : nullptr;
+        if (!view) {
+            throw std::runtime_error("Cannot map file: " + path);
+        }
+#else
+        void* view = mmap(nullptr, length, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+            MAP_SHARED, descriptor, 0);
+        if (view == MAP_FAILED) {
+            throw std::runtime_error("Cannot map file: " + path);
+        }
+#endif
+        address = static_cast<uint8_t*>(view);
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (address) UnmapViewOfFile(address);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (address) munmap(address, length);
+        if (descriptor >= 0) close(descriptor);
+        descriptor = -1;
+#endif
+        address = nullptr;
+        length = 0;
+    }
+
+    uint8_t* address = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int descriptor = -1;
+#endif
+};
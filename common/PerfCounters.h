@@ -0,0 +1,327 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#define PERF_COUNTERS_SUPPORTED 1
+#else
+#define PERF_COUNTERS_SUPPORTED 0
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Per-thread hardware counters through Linux perf_event_open, without any
+// external tool. Counters are opened for the calling thread only, so a
+// PerfCounters object must be started and stopped by the thread it measures.
+// Every event is opened on its own rather than as a group: a machine (or VM)
+// that lacks one of them still reports the others. Where the kernel
+// multiplexes events the values are scaled by enabled / running time.
+// On other platforms everything compiles and reports "n/a".
+
+enum class PerfCounter {
+    Cycles,
+    Instructions,
+    L1dMisses,
+    LlcMisses,
+    BranchMisses,
+    ContextSwitches,
+    Count
+};
+
+constexpr size_t PERF_COUNTERS_COUNT = static_cast<size_t>(PerfCounter::Count);
+
+inline const char* PerfCounterName(PerfCounter counter) {
+    static const char* const NAMES[PERF_COUNTERS_COUNT] = {
+        "cycles", "instructions", "L1d misses", "LLC misses", "branch misses", "context switches"
+    };
+    return NAMES[static_cast<size_t>(counter)];
+}
+
+struct PerfSample {
+    std::array<uint64_t, PERF_COUNTERS_COUNT> values{};
+    std::array<bool, PERF_COUNTERS_COUNT> available{};
+
+    uint64_t getValue(PerfCounter counter) const {
+        return values[static_cast<size_t>(counter)];
+    }
+
+    bool isAvailable(PerfCounter counter) const {
+        return available[static_cast<size_t>(counter)];
+    }
+
+    // Instructions per cycle, or 0 without both counters.
+    double getIpc() const {
+        if (!isAvailable(PerfCounter::Cycles) || !isAvailable(PerfCounter::Instructions)
+            || getValue(PerfCounter::Cycles) == 0) {
+            return 0.0;
+        }
+        return static_cast<double>(getValue(PerfCounter::Instructions)) / getValue(PerfCounter::Cycles);
+    }
+
+    PerfSample& operator+=(const PerfSample& other) {
+        for (size_t i = 0; i < PERF_COUNTERS_COUNT; ++i) {
+            values[i] += other.values[i];
+            available[i] = available[i] || other.available[i];
+        }
+        return *this;
+    }
+};
+
+class PerfCounters {
+public:
+    PerfCounters() {
+        descriptors.fill(-1);
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+#if PERF_COUNTERS_SUPPORTED
+        for (int descriptor : descriptors) {
+            if (descriptor >= 0) {
+                close(descriptor);
+            }
+        }
+#endif
+    }
+
+    // The first Start opens the events for the calling thread. Counts
+    // accumulate over every Start / Stop pair until Reset.
+    void Start() {
+#if PERF_COUNTERS_SUPPORTED
+        if (!opened) {
+            Open();
+        }
+        for (int descriptor : descriptors) {
+            if (descriptor >= 0) {
+                ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#else
+        error = "perf_event_open is Linux only";
+#endif
+    }
+
+    PerfSample Stop() {
+#if PERF_COUNTERS_SUPPORTED
+        for (int descriptor : descriptors) {
+            if (descriptor >= 0) {
+                ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+#endif
+        return Read();
+    }
+
+    void Reset() {
+#if PERF_COUNTERS_SUPPORTED
+        for (int descriptor : descriptors) {
+            if (descriptor >= 0) {
+                ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+            }
+        }
+#endif
+    }
+
+    PerfSample Read() const {
+        PerfSample sample;
+#if PERF_COUNTERS_SUPPORTED
+        for (size_t i = 0; i < PERF_COUNTERS_COUNT; ++i) {
+            // value, time enabled, time running
+            uint64_t data[3] = {};
+            if (descriptors[i] < 0 || read(descriptors[i], data, sizeof(data)) != sizeof(data)) {
+                continue;
+            }
+            sample.available[i] = true;
+            sample.values[i] = data[2] > 0 && data[2] < data[1] ?
+                static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]) : data[0];
+        }
+#endif
+        return sample;
+    }
+
+    // Why the first counter that failed to open did so; empty when all opened.
+    const std::string& getError() const {
+        return error;
+    }
+
+private:
+#if PERF_COUNTERS_SUPPORTED
+    void Open() {
+        opened = true;
+
+        struct Event {
+            uint32_t type;
+            uint64_t config;
+        };
+        static const Event EVENTS[PERF_COUNTERS_COUNT] = {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+            { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES }
+        };
+
+        for (size_t i = 0; i < PERF_COUNTERS_COUNT; ++i) {
+            perf_event_attr attributes;
+            std::memset(&attributes, 0, sizeof(attributes));
+            attributes.size = sizeof(attributes);
+            attributes.type = EVENTS[i].type;
+            attributes.config = EVENTS[i].config;
+            attributes.disabled = 1;
+            // Hardware events count user space only, which perf_event_paranoid
+            // up to 2 allows unprivileged. A context switch happens in the
+            // kernel, so the software event reads 0 with the kernel excluded;
+            // it keeps the kernel in, which unprivileged users only get with
+            // perf_event_paranoid at 1 or below. Under the default of 2 it
+            // fails to open and the column shows n/a.
+            attributes.exclude_kernel = EVENTS[i].type != PERF_TYPE_SOFTWARE;
+            attributes.exclude_hv = 1;
+            attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            descriptors[i] = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+            if (descriptors[i] < 0 && error.empty()) {
+                const int code = errno;
+                error = std::string(PerfCounterName(static_cast<PerfCounter>(i))) + ": " + std::strerror(code);
+                if (code == EACCES || code == EPERM) {
+                    error += ", see /proc/sys/kernel/perf_event_paranoid";
+                }
+            }
+        }
+    }
+
+    bool opened = false;
+#endif
+    std::array<int, PERF_COUNTERS_COUNT> descriptors;
+    std::string error;
+};
+
+// Samples per thread index, summed over every Add. Each index must only be
+// added to by one thread at a time, which holds for pool workers and for
+// OpenMP thread numbers.
+class PerfReport {
+public:
+    explicit PerfReport(size_t threadsCount = 0)
+        : samples(threadsCount), errors(threadsCount) {
+    }
+
+    // Stops counters, adds what they counted to the thread's row and resets
+    // them, so the same counters can be started again for the next region.
+    void Add(size_t threadIndex, PerfCounters& counters) {
+        samples.at(threadIndex) += counters.Stop();
+        counters.Reset();
+        if (errors[threadIndex].empty()) {
+            errors[threadIndex] = counters.getError();
+        }
+    }
+
+    size_t getThreadsCount() const {
+        return samples.size();
+    }
+
+    const PerfSample& getSample(size_t threadIndex) const {
+        return samples.at(threadIndex);
+    }
+
+    PerfSample getTotal() const {
+        PerfSample total;
+        for (const PerfSample& sample : samples) {
+            total += sample;
+        }
+        return total;
+    }
+
+    // One row per thread and a total row; unavailable counters print as n/a.
+    void Print(std::ostream& output, const std::string& title) const {
+        output << title << ":\n";
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-8s %14s %14s %6s %12s %12s %12s %8s\n",
+            "thread", "cycles", "instructions", "IPC", "L1d-miss", "LLC-miss", "br-miss", "ctx-sw");
+        output << line;
+        for (size_t i = 0; i < samples.size(); ++i) {
+            PrintRow(output, std::to_string(i), samples[i]);
+        }
+        PrintRow(output, "total", getTotal());
+
+        // The first failure is enough; a missing PMU fails the same way on every thread
+        for (const std::string& error : errors) {
+            if (!error.empty()) {
+                output << "Some counters are unavailable (" << error << ")\n";
+                break;
+            }
+        }
+    }
+
+private:
+    static std::string FormatValue(const PerfSample& sample, PerfCounter counter) {
+        return sample.isAvailable(counter) ? std::to_string(sample.getValue(counter)) : "n/a";
+    }
+
+    static void PrintRow(std::ostream& output, const std::string& label, const PerfSample& sample) {
+        char ipc[16] = "n/a";
+        if (sample.getIpc() > 0.0) {
+            std::snprintf(ipc, sizeof(ipc), "%.2f", sample.getIpc());
+        }
+        char line[160];
+        std::snprintf(line, sizeof(line), "%-8s %14s %14s %6s %12s %12s %12s %8s\n", label.c_str(),
+            FormatValue(sample, PerfCounter::Cycles).c_str(), FormatValue(sample, PerfCounter::Instructions).c_str(),
+            ipc, FormatValue(sample, PerfCounter::L1dMisses).c_str(), FormatValue(sample, PerfCounter::LlcMisses).c_str(),
+            FormatValue(sample, PerfCounter::BranchMisses).c_str(),
+            FormatValue(sample, PerfCounter::ContextSwitches).c_str());
+        output << line;
+    }
+
+    std::vector<PerfSample> samples;
+    std::vector<std::string> errors;
+};
+
+// Counts body() on every thread of the current OpenMP team size. The
+// counters are started and stopped from parallel regions of their own
+// around the call; OpenMP runtimes keep the same threads for consecutive
+// regions of one size, so thread i of body() is the thread i that was
+// measured. Without OpenMP only the calling thread is counted.
+template <typename Body>
+PerfReport MeasureOpenMp(Body&& body) {
+#ifdef _OPENMP
+    const int threadsCount = omp_get_max_threads();
+    PerfReport report(threadsCount);
+    std::vector<std::unique_ptr<PerfCounters>> counters(threadsCount);
+
+#pragma omp parallel num_threads(threadsCount)
+    {
+        const int thread = omp_get_thread_num();
+        counters[thread] = std::make_unique<PerfCounters>();
+        counters[thread]->Start();
+    }
+
+    body();
+
+#pragma omp parallel num_threads(threadsCount)
+    report.Add(omp_get_thread_num(), *counters[omp_get_thread_num()]);
+
+    return report;
+#else
+    PerfReport report(1);
+    PerfCounters counters;
+    counters.Start();
+    body();
+    report.Add(0, counters);
+    return report;
+#endif
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <thread>
+
+#ifdef _WIN32
+// std::min and std::max stay usable after windows.h
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <cstdlib>
+#endif
+
+// Pins a thread to a single logical CPU. Linux CPU sets reach CPU_SETSIZE
+// CPUs; on Windows, CPUs past the first 64 sit in further processor groups,
+// which a plain affinity mask cannot name.
+inline bool PinThread(std::thread::native_handle_type thread, int cpu) {
+#ifdef _WIN32
+    WORD group = 0;
+    const WORD groupsCount = GetActiveProcessorGroupCount();
+    while (group + 1 < groupsCount && cpu >= static_cast<int>(GetActiveProcessorCount(group))) {
+        cpu -= static_cast<int>(GetActiveProcessorCount(group));
+        ++group;
+    }
+    GROUP_AFFINITY affinity = {};
+    affinity.Group = group;
+    affinity.Mask = static_cast<KAFFINITY>(1) << cpu;
+    return SetThreadGroupAffinity(static_cast<HANDLE>(thread), &affinity, nullptr) != 0;
+#else
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    return pthread_setaffinity_np(thread, sizeof(cpuSet), &cpuSet) == 0;
+#endif
+}
+
+// Pins the calling thread to a single logical core.
+inline void PinCurrentThread(int core) {
+#ifdef _WIN32
+    PinThread(GetCurrentThread(), core);
+#else
+    PinThread(pthread_self(), core);
+#endif
+}
+
+// Restricts every thread of the process to the cores set in mask (bit i is
+// core i), as SetProcessAffinityMask does. Linux has no process-wide call,
+// so each existing thread is set in turn; threads created later inherit the
+// mask from their creator.
+inline bool SetProcessAffinity(uint64_t mask) {
+#ifdef _WIN32
+    return SetProcessAffinityMask(GetCurrentProcess(), static_cast<DWORD_PTR>(mask)) != 0;
+#else
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int core = 0; core < 64 && core < CPU_SETSIZE; ++core) {
+        if (mask >> core & 1) {
+            CPU_SET(core, &cpuSet);
+        }
+    }
+
+    DIR* tasks = opendir("/proc/self/task");
+    if (!tasks) {
+        return sched_setaffinity(0, sizeof(cpuSet), &cpuSet) == 0;
+    }
+    bool succeeded = true;
+    while (dirent* entry = readdir(tasks)) {
+        if (entry->d_name[0] != '.') {
+            succeeded = sched_setaffinity(std::atoi(entry->d_name), sizeof(cpuSet), &cpuSet) == 0 && succeeded;
+        }
+    }
+    closedir(tasks);
+    return succeeded;
+#endif
+}
+
+// Pins the calling thread for the lifetime of the object and then puts its
+// previous affinity back. Threads created meanwhile inherit the pin on
+// Linux, so keep the scope around single-threaded work.
+class ScopedThreadPin {
+public:
+    explicit ScopedThreadPin(int core) {
+#ifdef _WIN32
+        previousMask = SetThreadAffinityMask(GetCurrentThread(), static_cast<DWORD_PTR>(1) << core);
+#else
+        pthread_getaffinity_np(pthread_self(), sizeof(previousSet), &previousSet);
+        PinCurrentThread(core);
+#endif
+    }
+
+    ScopedThreadPin(const ScopedThreadPin&) = delete;
+    ScopedThreadPin& operator=(const ScopedThreadPin&) = delete;
+
+    ~ScopedThreadPin() {
+#ifdef _WIN32
+        if (previousMask) {
+            SetThreadAffinityMask(GetCurrentThread(), previousMask);
+        }
+#else
+        pthread_setaffinity_np(pthread_self(), sizeof(previousSet), &previousSet);
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    DWORD_PTR previousMask = 0;
+#else
+    cpu_set_t previousSet;
+#endif
+};
@@ -0,0 +1,223 @@
+#pragma once
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "ThreadAffinity.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// Thin portable layer over the Win32 calls the labs were written against:
+// CreateThread (optionally suspended) / ResumeThread / WaitForMultipleObjects,
+// SetThreadPriority, SetThreadAffinityMask, semaphores and timeGetTime. On
+// Linux it maps onto pthreads, per-thread nice values, sched affinity and
+// clock_gettime.
+
+// Counting semaphore with an optional ceiling, like CreateSemaphore.
+class Semaphore {
+public:
+    explicit Semaphore(long initialCount = 0, long maximumCount = LONG_MAX)
+        : count(initialCount), maximumCount(maximumCount) {
+    }
+
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+
+    void Acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        available.wait(lock, [this] { return count > 0; });
+        --count;
+    }
+
+    bool TryAcquireFor(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!available.wait_for(lock, timeout, [this] { return count > 0; })) {
+            return false;
+        }
+        --count;
+        return true;
+    }
+
+    // Fails without changing the count if it would pass the ceiling, as
+    // ReleaseSemaphore does.
+    bool Release(long releaseCount = 1) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (count > maximumCount - releaseCount) {
+                return false;
+            }
+            count += releaseCount;
+        }
+        if (releaseCount == 1) {
+            available.notify_one();
+        }
+        else {
+            available.notify_all();
+        }
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable available;
+    long count;
+    long maximumCount;
+};
+
+// Relative levels of the Win32 priority scale. Linux threads of the normal
+// policy have no static priority, so each level becomes a nice value of the
+// thread alone: +10, +5, 0, -5 and -10. Raising priority there needs
+// CAP_SYS_NICE; without it SetPriority fails for AboveNormal and Highest.
+enum class ThreadPriority {
+    Lowest,
+    BelowNormal,
+    Normal,
+    AboveNormal,
+    Highest
+};
+
+// A joinable thread that can start suspended, so priority and affinity are
+// in place before it runs its first instruction of work. The destructor
+// resumes and joins it.
+class Thread {
+public:
+    Thread() = default;
+
+    explicit Thread(std::function<void()> function, bool suspended = false)
+        : state(std::make_unique<State>()) {
+        state->resumed = !suspended;
+        if (!suspended) {
+            state->gate.Release();
+        }
+
+        State* shared = state.get();
+        state->thread = std::thread([shared, function = std::move(function)]() {
+#ifndef _WIN32
+            shared->tid = static_cast<pid_t>(syscall(SYS_gettid));
+#endif
+            shared->started.Release();
+            shared->gate.Acquire();
+            function();
+        });
+
+        // The thread id is only known once the thread runs
+        state->started.Acquire();
+    }
+
+    Thread(Thread&& other) noexcept = default;
+
+    Thread& operator=(Thread&& other) noexcept {
+        if (this != &other) {
+            Join();
+            state = std::move(other.state);
+        }
+        return *this;
+    }
+
+    ~Thread() {
+        Join();
+    }
+
+    void Resume() {
+        if (state && !state->resumed) {
+            state->resumed = true;
+            state->gate.Release();
+        }
+    }
+
+    // Resumes the thread if it is still suspended, then waits for it.
+    void Join() {
+        if (state && state->thread.joinable()) {
+            Resume();
+            state->thread.join();
+        }
+    }
+
+    bool SetPriority(ThreadPriority priority) {
+#ifdef _WIN32
+        static const int LEVELS[] = {
+            THREAD_PRIORITY_LOWEST, THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_NORMAL,
+            THREAD_PRIORITY_ABOVE_NORMAL, THREAD_PRIORITY_HIGHEST
+        };
+        return SetThreadPriority(state->thread.native_handle(), LEVELS[static_cast<int>(priority)]) != 0;
+#else
+        static const int NICE_VALUES[] = { 10, 5, 0, -5, -10 };
+        return setpriority(PRIO_PROCESS, static_cast<id_t>(state->tid), NICE_VALUES[static_cast<int>(priority)]) == 0;
+#endif
+    }
+
+    // Bit i of mask allows core i, as in SetThreadAffinityMask.
+    bool SetAffinity(uint64_t mask) {
+#ifdef _WIN32
+        return SetThreadAffinityMask(state->thread.native_handle(), static_cast<DWORD_PTR>(mask)) != 0;
+#else
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (int core = 0; core < 64 && core < CPU_SETSIZE; ++core) {
+            if (mask >> core & 1) {
+                CPU_SET(core, &cpuSet);
+            }
+        }
+        return pthread_setaffinity_np(state->thread.native_handle(), sizeof(cpuSet), &cpuSet) == 0;
+#endif
+    }
+
+    // Any logical CPU, including those past the 64 a mask can hold.
+    bool PinToCore(int core) {
+        return PinThread(state->thread.native_handle(), core);
+    }
+
+private:
+    struct State {
+        std::thread thread;
+        Semaphore started;
+        Semaphore gate;
+        bool resumed = false;
+#ifndef _WIN32
+        pid_t tid = 0;
+#endif
+    };
+
+    // Heap-allocated so the running thread keeps a stable pointer when the
+    // Thread object is moved, e.g. into a vector.
+    std::unique_ptr<State> state;
+};
+
+// Milliseconds from an arbitrary fixed point, never going backwards; the
+// portable stand-in for timeGetTime.
+inline uint64_t MonotonicMilliseconds() {
+#ifdef _WIN32
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000 + static_cast<uint64_t>(now.tv_nsec) / 1000000;
+#endif
+}
+
+// Spin-wait hint: lets the sibling hardware thread run and saves power
+// while a spinning thread polls a lock word.
+inline void CpuRelax() {
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
@@ -0,0 +1,281 @@
+#pragma once
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#ifndef _WIN32
+#include <sched.h>
+#endif
+
+// Which logical CPUs share a core, a package and a NUMA node, and plans that
+// map worker i to a logical CPU. On Linux the layout comes from sysfs; other
+// platforms see every logical CPU as its own core on one package and node.
+
+struct LogicalCpu {
+    int id;
+    int package;
+    // Unique across packages, unlike core_id in sysfs
+    int core;
+    int node;
+    // 0 for the first hardware thread of a core, 1 for its SMT sibling, ...
+    int smtIndex;
+};
+
+class CpuTopology {
+public:
+    static CpuTopology Detect(const std::string& sysfsRoot = "/sys/devices/system") {
+        CpuTopology topology;
+#ifndef _WIN32
+        std::string online;
+        if (ReadLine(sysfsRoot + "/cpu/online", online)) {
+            std::map<int, int> nodeOfCpu;
+            std::string nodes;
+            if (ReadLine(sysfsRoot + "/node/online", nodes)) {
+                for (int node : ParseCpuList(nodes)) {
+                    std::string cpus;
+                    if (ReadLine(sysfsRoot + "/node/node" + std::to_string(node) + "/cpulist", cpus)) {
+                        for (int cpu : ParseCpuList(cpus)) {
+                            nodeOfCpu[cpu] = node;
+                        }
+                    }
+                }
+            }
+
+            std::map<std::pair<int, int>, int> coreIds;
+            for (int cpu : ParseCpuList(online)) {
+                const std::string path = sysfsRoot + "/cpu/cpu" + std::to_string(cpu) + "/topology/";
+                std::string package = "0";
+                std::string core = std::to_string(cpu);
+                std::string siblings = std::to_string(cpu);
+                ReadLine(path + "physical_package_id", package);
+                ReadLine(path + "core_id", core);
+                ReadLine(path + "thread_siblings_list", siblings);
+
+                const std::pair<int, int> key(std::stoi(package), std::stoi(core));
+                const auto inserted = coreIds.emplace(key, static_cast<int>(coreIds.size()));
+                const std::vector<int> siblingIds = ParseCpuList(siblings);
+                const int smtIndex = static_cast<int>(
+                    std::find(siblingIds.begin(), siblingIds.end(), cpu) - siblingIds.begin());
+
+                topology.cpus.push_back({ cpu, key.first, inserted.first->second,
+                    nodeOfCpu.count(cpu) ? nodeOfCpu[cpu] : 0, smtIndex < static_cast<int>(siblingIds.size()) ? smtIndex : 0 });
+            }
+        }
+#endif
+        if (topology.cpus.empty()) {
+            const int count = std::max(1u, std::thread::hardware_concurrency());
+            for (int cpu = 0; cpu < count; ++cpu) {
+                topology.cpus.push_back({ cpu, 0, cpu, 0, 0 });
+            }
+        }
+        return topology;
+    }
+
+    // "0-3,8,10-11" -> 0 1 2 3 8 10 11
+    static std::vector<int> ParseCpuList(const std::string& list) {
+        std::vector<int> cpus;
+        std::stringstream stream(list);
+        std::string range;
+        while (std::getline(stream, range, ',')) {
+            if (range.empty() || range == "\n") {
+                continue;
+            }
+            const size_t dash = range.find('-');
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    const std::vector<LogicalCpu>& getCpus() const {
+        return cpus;
+    }
+
+    int getPackagesCount() const {
+        return CountDistinct(&LogicalCpu::package);
+    }
+
+    int getCoresCount() const {
+        return CountDistinct(&LogicalCpu::core);
+    }
+
+    int getNodesCount() const {
+        return CountDistinct(&LogicalCpu::node);
+    }
+
+    // NUMA node of the CPU the caller is running on, i.e. where its first
+    // touches of fresh memory land.
+    int getCurrentNode() const {
+#ifndef _WIN32
+        const int current = sched_getcpu();
+        for (const LogicalCpu& cpu : cpus) {
+            if (cpu.id == current) {
+                return cpu.node;
+            }
+        }
+#endif
+        return cpus.front().node;
+    }
+
+    std::string Describe() const {
+        return std::to_string(cpus.size()) + " logical CPUs, " + std::to_string(getCoresCount()) + " cores, "
+            + std::to_string(getPackagesCount()) + " packages, " + std::to_string(getNodesCount()) + " NUMA nodes";
+    }
+
+private:
+    static bool ReadLine(const std::string& path, std::string& line) {
+        std::ifstream file(path);
+        return file && std::getline(file, line) && !line.empty();
+    }
+
+    int CountDistinct(int LogicalCpu::* field) const {
+        std::set<int> values;
+        for (const LogicalCpu& cpu : cpus) {
+            values.insert(cpu.*field);
+        }
+        return static_cast<int>(values.size());
+    }
+
+    std::vector<LogicalCpu> cpus;
+};
+
+// linear   CPUs in id order: worker i on CPU i, the old i % coresCount layout
+// compact  fill a core's SMT siblings, then the next core, then the next package
+// scatter  one core per package in turn, SMT siblings only once every core is busy
+// physical first hardware thread of every core, never two workers on one core
+// numa     only the CPUs of one node, cores before siblings; memory stays local
+enum class PlacementPolicy {
+    Linear,
+    Compact,
+    Scatter,
+    Physical,
+    Numa
+};
+
+struct Placement {
+    PlacementPolicy policy = PlacementPolicy::Linear;
+    // For Numa; -1 picks the node the planning thread runs on
+    int node = -1;
+
+    // "compact", "scatter", "physical", "linear", "numa" or "numa:<node>"
+    static Placement Parse(const std::string& text) {
+        Placement placement;
+        const std::string name = text.substr(0, text.find(':'));
+        if (name == "linear") placement.policy = PlacementPolicy::Linear;
+        else if (name == "compact") placement.policy = PlacementPolicy::Compact;
+        else if (name == "scatter") placement.policy = PlacementPolicy::Scatter;
+        else if (name == "physical") placement.policy = PlacementPolicy::Physical;
+        else if (name == "numa") placement.policy = PlacementPolicy::Numa;
+        else throw std::invalid_argument("Unknown placement: " + text);
+
+        if (text.find(':') != std::string::npos) {
+            if (placement.policy != PlacementPolicy::Numa) {
+                throw std::invalid_argument("Only numa takes a node: " + text);
+            }
+            placement.node = std::stoi(text.substr(text.find(':') + 1));
+        }
+        return placement;
+    }
+
+    const char* getName() const {
+        static const char* const NAMES[] = { "linear", "compact", "scatter", "physical", "numa" };
+        return NAMES[static_cast<int>(policy)];
+    }
+};
+
+// CPU order the policy hands out; worker i takes entry i modulo its length.
+inline std::vector<int> OrderCpus(const CpuTopology& topology, const Placement& placement) {
+    std::vector<LogicalCpu> cpus = topology.getCpus();
+
+    // Rank of each core inside its package, so scatter can interleave packages
+    std::map<int, int> coreRank;
+    std::map<int, int> coresPerPackage;
+    for (const LogicalCpu& cpu : cpus) {
+        if (!coreRank.count(cpu.core)) {
+            coreRank[cpu.core] = coresPerPackage[cpu.package]++;
+        }
+    }
+
+    auto byId = [](const LogicalCpu& a, const LogicalCpu& b) { return a.id < b.id; };
+    auto compact = [](const LogicalCpu& a, const LogicalCpu& b) {
+        return std::tie(a.package, a.core, a.smtIndex) < std::tie(b.package, b.core, b.smtIndex);
+    };
+    auto scatter = [&coreRank](const LogicalCpu& a, const LogicalCpu& b) {
+        return std::make_tuple(a.smtIndex, coreRank[a.core], a.package) < std::make_tuple(b.smtIndex, coreRank[b.core], b.package);
+    };
+    auto coresFirst = [](const LogicalCpu& a, const LogicalCpu& b) {
+        return std::tie(a.smtIndex, a.package, a.core) < std::tie(b.smtIndex, b.package, b.core);
+    };
+
+    switch (placement.policy) {
+    case PlacementPolicy::Linear:
+        std::sort(cpus.begin(), cpus.end(), byId);
+        break;
+    case PlacementPolicy::Compact:
+        std::sort(cpus.begin(), cpus.end(), compact);
+        break;
+    case PlacementPolicy::Scatter:
+        std::sort(cpus.begin(), cpus.end(), scatter);
+        break;
+    case PlacementPolicy::Physical:
+        cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [](const LogicalCpu& cpu) { return cpu.smtIndex > 0; }),
+            cpus.end());
+        std::sort(cpus.begin(), cpus.end(), compact);
+        break;
+    case PlacementPolicy::Numa: {
+        const int node = placement.node >= 0 ? placement.node : topology.getCurrentNode();
+        cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [node](const LogicalCpu& cpu) { return cpu.node != node; }),
+            cpus.end());
+        if (cpus.empty()) {
+            throw std::invalid_argument("NUMA node " + std::to_string(node) + " has no online CPUs");
+        }
+        std::sort(cpus.begin(), cpus.end(), coresFirst);
+        break;
+    }
+    }
+
+    std::vector<int> order;
+    for (const LogicalCpu& cpu : cpus) {
+        order.push_back(cpu.id);
+    }
+    return order;
+}
+
+// CPU for each of threadsCount workers. A positive cpusLimit keeps only the
+// first cpusLimit CPUs of the order, which is how the labs' core-count
+// argument restricts a run to part of the machine.
+inline std::vector<int> PlanPlacement(const CpuTopology& topology, const Placement& placement,
+    int threadsCount, int cpusLimit = 0) {
+    std::vector<int> order = OrderCpus(topology, placement);
+    if (cpusLimit > 0 && cpusLimit < static_cast<int>(order.size())) {
+        order.resize(cpusLimit);
+    }
+
+    std::vector<int> plan;
+    for (int i = 0; i < threadsCount; ++i) {
+        plan.push_back(order[i % order.size()]);
+    }
+    return plan;
+}
+
+// "0 2 4 6" for printing a plan
+inline std::string FormatCpuList(const std::vector<int>& cpus) {
+    std::string text;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        if (i) {
+            text += ' ';
+        }
+        text += std::to_string(cpus[i]);
+    }
+    return text;
+}